@@ -0,0 +1,102 @@
+/*
+ * A simple bump allocator
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE    (64 * 1024)
+#define ARENA_ALIGN         16
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    /* keep the data aligned */
+    union {
+        long double ld;
+        void *p;
+        long long ll;
+    } data[];
+};
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    struct arena_block *block = arena->head;
+    void *ret;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (!block || block->size - block->used < size)
+    {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+        block = malloc(sizeof(*block) + block_size);
+        block->size = block_size;
+        block->used = 0;
+
+        /* An oversized allocation gets a block of its own; put it behind the
+         * current block so that we keep filling that one. */
+        if (arena->head && block_size > ARENA_BLOCK_SIZE)
+        {
+            block->next = arena->head->next;
+            arena->head->next = block;
+        }
+        else
+        {
+            block->next = arena->head;
+            arena->head = block;
+        }
+    }
+
+    ret = (char *)block->data + block->used;
+    block->used += size;
+    return ret;
+}
+
+void *arena_calloc(struct arena *arena, size_t count, size_t size)
+{
+    void *ret = arena_alloc(arena, count * size);
+    memset(ret, 0, count * size);
+    return ret;
+}
+
+char *arena_strndup(struct arena *arena, const char *str, size_t len)
+{
+    char *ret = arena_alloc(arena, len + 1);
+    memcpy(ret, str, len);
+    ret[len] = 0;
+    return ret;
+}
+
+void arena_free(struct arena *arena)
+{
+    struct arena_block *block, *next;
+
+    for (block = arena->head; block; block = next)
+    {
+        next = block->next;
+        free(block);
+    }
+    arena->head = NULL;
+}
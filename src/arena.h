@@ -0,0 +1,20 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stddef.h>
+
+/* A simple bump allocator. Everything allocated from an arena is freed at
+ * once, when the arena is. */
+
+struct arena_block;
+
+struct arena {
+    struct arena_block *head;
+};
+
+extern void *arena_alloc(struct arena *arena, size_t size);
+extern void *arena_calloc(struct arena *arena, size_t count, size_t size);
+extern char *arena_strndup(struct arena *arena, const char *str, size_t len);
+extern void arena_free(struct arena *arena);
+
+#endif /* __ARENA_H */
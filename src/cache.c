@@ -0,0 +1,365 @@
+/*
+ * Caching scan results on disk (--cache-dir)
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "semblance.h"
+#include "cache.h"
+#include "dedup.h"
+#include "sha256.h"
+
+const char *cache_dir;
+off_t cache_memory;
+
+#define ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+/* The scanner can change between versions, so results from another version
+ * are never used. It also goes by the names of instructions, which depend on
+ * the syntax (e.g. GAS "lcall"). */
+static void get_key(struct cache_key *key)
+{
+    struct sha256 ctx;
+    dword version = CACHE_VERSION;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, VERSION, strlen(VERSION) + 1);
+    sha256_update(&ctx, &version, sizeof(version));
+    sha256_update(&ctx, &asm_syntax, sizeof(asm_syntax));
+    sha256_update(&ctx, map, map_size);
+    sha256_final(&ctx, key->digest);
+}
+
+static int same_key(const struct cache_key *a, const struct cache_key *b)
+{
+    return !memcmp(a->digest, b->digest, sizeof(a->digest));
+}
+
+static size_t get_size(const struct cache_array *arrays, unsigned count)
+{
+    size_t size = sizeof(struct cache_header) + count * sizeof(qword);
+    unsigned i;
+
+    for (i = 0; i < count; i++)
+        size += ALIGN(arrays[i].size);
+    return size;
+}
+
+/* Fill in the arrays from a cache file, if it's the one we want. The whole
+ * file is checked before we touch the arrays, so that the caller can still
+ * scan if it's been damaged. */
+static int read_cache(const byte *data, size_t size, const struct cache_key *key,
+        const struct cache_array *arrays, unsigned count)
+{
+    const struct cache_header *header = (const struct cache_header *)data;
+    const qword *sizes = (const qword *)(header + 1);
+    const byte *p;
+    qword check = 0;
+    unsigned i;
+
+    if (size != get_size(arrays, count)
+            || memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic))
+            || header->version != CACHE_VERSION || !same_key(&header->key, key)
+            || header->file_size != map_size || header->count != count)
+        return 0;
+
+    p = (const byte *)(sizes + count);
+    for (i = 0; i < count && sizes[i] == arrays[i].size; i++)
+    {
+        check = hash_data(p, arrays[i].size, check);
+        p += ALIGN(arrays[i].size);
+    }
+    if (i < count || check != header->check)
+        return 0;
+
+    p = (const byte *)(sizes + count);
+    for (i = 0; i < count; i++)
+    {
+        memcpy(arrays[i].data, p, arrays[i].size);
+        p += ALIGN(arrays[i].size);
+    }
+    return 1;
+}
+
+static byte *write_cache(const struct cache_key *key, const struct cache_array *arrays, unsigned count, size_t size)
+{
+    struct cache_header *header;
+    qword *sizes;
+    byte *data, *p;
+    unsigned i;
+
+    data = calloc(1, size);
+    header = (struct cache_header *)data;
+    sizes = (qword *)(header + 1);
+
+    memcpy(header->magic, CACHE_MAGIC, sizeof(header->magic));
+    header->version = CACHE_VERSION;
+    header->key = *key;
+    header->file_size = map_size;
+    header->count = count;
+
+    p = (byte *)(sizes + count);
+    for (i = 0; i < count; i++)
+    {
+        sizes[i] = arrays[i].size;
+        memcpy(p, arrays[i].data, arrays[i].size);
+        header->check = hash_data(p, arrays[i].size, header->check);
+        p += ALIGN(arrays[i].size);
+    }
+    return data;
+}
+
+/* In memory.
+ *
+ * The server keeps the most recently used cache files in memory, up to
+ * cache_memory bytes. This is a list, most recently used first; there are
+ * few enough entries that searching it is nothing next to a scan. */
+
+struct memory_entry
+{
+    struct memory_entry *prev, *next;
+    struct cache_key key;
+    byte *data;
+    size_t size;
+};
+
+static struct memory_entry *lru_head, *lru_tail;
+static size_t memory_used;
+static pthread_mutex_t memory_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void unlink_entry(struct memory_entry *entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        lru_head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        lru_tail = entry->prev;
+}
+
+static void push_entry(struct memory_entry *entry)
+{
+    entry->prev = NULL;
+    entry->next = lru_head;
+    if (lru_head)
+        lru_head->prev = entry;
+    else
+        lru_tail = entry;
+    lru_head = entry;
+}
+
+static void free_entry(struct memory_entry *entry)
+{
+    unlink_entry(entry);
+    memory_used -= entry->size;
+    free(entry->data);
+    free(entry);
+}
+
+static struct memory_entry *find_entry(const struct cache_key *key)
+{
+    struct memory_entry *entry;
+
+    for (entry = lru_head; entry; entry = entry->next)
+    {
+        if (same_key(&entry->key, key))
+            return entry;
+    }
+    return NULL;
+}
+
+static int memory_load(const struct cache_key *key, const struct cache_array *arrays, unsigned count)
+{
+    struct memory_entry *entry;
+    int ret = 0;
+
+    pthread_mutex_lock(&memory_lock);
+    if ((entry = find_entry(key)))
+    {
+        unlink_entry(entry);
+        push_entry(entry);
+        ret = read_cache(entry->data, entry->size, key, arrays, count);
+    }
+    pthread_mutex_unlock(&memory_lock);
+    return ret;
+}
+
+/* Takes ownership of "data". */
+static void memory_store(const struct cache_key *key, byte *data, size_t size)
+{
+    struct memory_entry *entry;
+
+    if (size > cache_memory)
+    {
+        free(data);
+        return;
+    }
+
+    pthread_mutex_lock(&memory_lock);
+    if ((entry = find_entry(key)))
+        free_entry(entry);
+    while (memory_used + size > cache_memory)
+        free_entry(lru_tail);
+
+    entry = malloc(sizeof(*entry));
+    entry->key = *key;
+    entry->data = data;
+    entry->size = size;
+    push_entry(entry);
+    memory_used += size;
+    pthread_mutex_unlock(&memory_lock);
+}
+
+/* On disk */
+
+static char *get_path(const struct cache_key *key)
+{
+    char *path = malloc(strlen(cache_dir) + 2 * SHA256_DIGEST_SIZE + 7);
+    char *p;
+    unsigned i;
+
+    p = path + sprintf(path, "%s/", cache_dir);
+    for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+        p += sprintf(p, "%02x", key->digest[i]);
+    strcpy(p, ".scan");
+    return path;
+}
+
+static int disk_load(const struct cache_key *key, const struct cache_array *arrays, unsigned count)
+{
+    size_t size = get_size(arrays, count);
+    char *path = get_path(key);
+    struct stat st;
+    byte *data;
+    int fd, ret;
+
+    fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0)
+        return 0;
+
+    if (fstat(fd, &st) < 0 || st.st_size != size
+            || (data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        return 0;
+    }
+    close(fd);
+
+    if ((ret = read_cache(data, size, key, arrays, count)) && cache_memory)
+    {
+        byte *copy = malloc(size);
+
+        memcpy(copy, data, size);
+        memory_store(key, copy, size);
+    }
+    munmap(data, size);
+    return ret;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const byte *p = data;
+    ssize_t ret;
+
+    while (size)
+    {
+        if ((ret = write(fd, p, size)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        p += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+static void disk_store(const struct cache_key *key, const byte *data, size_t size)
+{
+    char *path = get_path(key);
+    char *temp = malloc(strlen(cache_dir) + 15);
+    int fd, ok;
+
+    /* Write to a temporary file and rename it into place, so that other
+     * threads or processes never see a partial file. */
+    sprintf(temp, "%s/.scan-XXXXXX", cache_dir);
+    if ((fd = mkstemp(temp)) < 0)
+    {
+        fprintf(stderr, "Cannot create %s: %s\n", temp, strerror(errno));
+        free(temp);
+        free(path);
+        return;
+    }
+
+    ok = write_all(fd, data, size);
+    if (close(fd) < 0)
+        ok = 0;
+    if (!ok || rename(temp, path) < 0)
+    {
+        fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+        unlink(temp);
+    }
+    free(temp);
+    free(path);
+}
+
+int cache_enabled(void)
+{
+    return cache_dir || cache_memory;
+}
+
+int cache_load(struct cache_key *key, const struct cache_array *arrays, unsigned count)
+{
+    get_key(key);
+    if (cache_memory && memory_load(key, arrays, count))
+        return 1;
+    return cache_dir && disk_load(key, arrays, count);
+}
+
+void cache_store(const struct cache_key *key, const struct cache_array *arrays, unsigned count)
+{
+    size_t size = get_size(arrays, count);
+    byte *data;
+
+    /* Sections can claim to be far bigger than the file, but nothing past
+     * its end is ever scanned, so that isn't worth keeping. */
+    if (size > map_size + (1 << 20))
+        return;
+
+    data = write_cache(key, arrays, count, size);
+    if (cache_dir)
+        disk_store(key, data, size);
+    if (cache_memory)
+        memory_store(key, data, size);
+    else
+        free(data);
+}
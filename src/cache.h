@@ -0,0 +1,61 @@
+#ifndef __CACHE_H
+#define __CACHE_H
+
+#include "semblance.h"
+#include "sha256.h"
+
+/* With --cache-dir, what we learn from scanning a file's code (the flags for
+ * each byte: which are instructions, functions, jump targets, and so on) is
+ * saved in the cache directory, under the SHA-256 of the file's contents. The
+ * next time the same file is disassembled, with whatever output options, the
+ * flags are read back instead of scanning again.
+ *
+ * A cache file is a struct cache_header, followed by "count" qwords giving
+ * the size of each array, followed by the arrays, each aligned to 8 bytes.
+ * It's written for this machine's byte order, and is meant to be mapped.
+ *
+ * The server (--server) also keeps recently used cache files in memory. */
+
+#define CACHE_MAGIC     "SMBC"
+#define CACHE_VERSION   2
+
+/* The SHA-256 of the scanner's version and syntax, and of the file. A cache
+ * file can come from anywhere the cache directory is shared with, so a file
+ * mustn't be able to pass for another one. */
+struct cache_key
+{
+    byte digest[SHA256_DIGEST_SIZE];
+};
+
+struct cache_header
+{
+    char magic[4];
+    dword version;
+    struct cache_key key;
+    qword file_size;
+    qword check;        /* hash_data() of the arrays, one after another */
+    dword count;
+    dword reserved;
+};
+
+struct cache_array
+{
+    byte *data;
+    size_t size;
+};
+
+extern const char *cache_dir;
+/* How much to keep in memory, or 0 to keep nothing. */
+extern off_t cache_memory;
+
+extern int cache_enabled(void);
+
+/* Fill in the arrays for the current file from the cache. Returns 0 if they
+ * aren't there, or don't have the sizes given. Either way the file's key is
+ * put in *key, to be given to cache_store(). */
+extern int cache_load(struct cache_key *key, const struct cache_array *arrays, unsigned count);
+
+/* Save the arrays for the current file. */
+extern void cache_store(const struct cache_key *key, const struct cache_array *arrays, unsigned count);
+
+#endif /* __CACHE_H */
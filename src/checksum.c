@@ -0,0 +1,114 @@
+/*
+ * Functions for verifying image checksums
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "semblance.h"
+
+/* Both checksums can be derived from the plain sum of the file taken as
+ * little-endian dwords. The PE checksum is a 16-bit ones' complement sum, and
+ * since 0x10000 is congruent to 1 modulo 0xffff, a dword is congruent to the
+ * sum of its two words; the NE checksum is simply the dword sum truncated to 32
+ * bits. So we only need one pass over the file, which we can do 16 bytes at a
+ * time. Trailing bytes are taken to be padded with zeroes. */
+static qword sum_dwords(const byte *p, size_t len)
+{
+    qword sum = 0;
+    size_t i = 0;
+    dword last = 0;
+
+#ifdef __SSE2__
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc0 = zero, acc1 = zero;
+        qword lanes[2];
+
+        /* Widen each dword to a qword lane so that we never overflow; a
+         * 64-bit lane can't overflow for any file that fits in memory. */
+        for (; i + 32 <= len; i += 32)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(p + i + 16));
+            acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+            acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+            acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(b, zero));
+            acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(b, zero));
+        }
+        _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+        sum = lanes[0] + lanes[1];
+    }
+#endif
+
+    for (; i + 4 <= len; i += 4)
+        sum += *(const dword *)(p + i);
+
+    memcpy(&last, p + i, len - i);
+    return sum + last;
+}
+
+/* Compute the checksum of a PE image, as CheckSumMappedFile() does. The
+ * checksum field itself is at the given offset. */
+dword pe_checksum(off_t checksum_offset)
+{
+    dword stored = read_dword(checksum_offset);
+    qword sum = sum_dwords(read_data(0), map_size);
+    dword ret;
+
+    /* Fold down to a 16-bit ones' complement sum. The only way to get zero is
+     * for the whole file to be zero. */
+    if (!sum)
+        ret = 0;
+    else if (!(ret = sum % 0xffff))
+        ret = 0xffff;
+
+    /* Subtract the stored checksum, one word at a time, in the same way that
+     * Windows does, so that we get the same representation of zero. */
+    if (ret >= (stored & 0xffff))
+        ret -= (stored & 0xffff);
+    else
+        ret = ((ret - (stored & 0xffff)) & 0xffff) - 1;
+
+    if (ret >= (stored >> 16))
+        ret -= (stored >> 16);
+    else
+        ret = ((ret - (stored >> 16)) & 0xffff) - 1;
+
+    return ret + map_size;
+}
+
+/* Compute the checksum of an NE image. This is the 32-bit sum of every dword
+ * in the file, with the checksum field itself taken as zero. */
+dword ne_checksum(off_t crc_offset)
+{
+    dword field = 0;
+    int i;
+
+    /* The field need not be dword-aligned, so take each byte out of the sum
+     * at the position it was added in. */
+    for (i = 0; i < 4; i++)
+        field += (dword)read_byte(crc_offset + i) << (8 * ((crc_offset + i) & 3));
+
+    return sum_dwords(read_data(0), map_size) - field;
+}
@@ -0,0 +1,314 @@
+/*
+ * Skipping files and sections we have already dumped (--dedup)
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "semblance.h"
+#include "dedup.h"
+
+int dedup;
+
+/* Hashing */
+
+#define PRIME1 0x9e3779b185ebca87ull
+#define PRIME2 0xc2b2ae3d27d4eb4full
+#define PRIME3 0x165667b19e3779f9ull
+
+static inline qword rotl(qword x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline qword round64(qword acc, qword input)
+{
+    return rotl(acc + input * PRIME2, 31) * PRIME1;
+}
+
+static inline qword load64(const byte *p)
+{
+    qword value;
+
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/* This is the same shape as XXH64: four lanes of 8 bytes each, so that the
+ * multiplies can run in parallel, folded together at the end. */
+qword hash_data(const void *data, size_t len, qword seed)
+{
+    const byte *p = data, *end = p + len;
+    qword hash;
+
+    if (len >= 32)
+    {
+        qword v1 = seed + PRIME1 + PRIME2, v2 = seed + PRIME2, v3 = seed, v4 = seed - PRIME1;
+
+        do
+        {
+            v1 = round64(v1, load64(p));
+            v2 = round64(v2, load64(p + 8));
+            v3 = round64(v3, load64(p + 16));
+            v4 = round64(v4, load64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = (hash ^ round64(0, v1)) * PRIME1;
+        hash = (hash ^ round64(0, v2)) * PRIME1;
+        hash = (hash ^ round64(0, v3)) * PRIME1;
+        hash = (hash ^ round64(0, v4)) * PRIME1;
+    }
+    else
+        hash = seed + PRIME3;
+
+    hash += len;
+    for (; end - p >= 8; p += 8)
+        hash = rotl(hash ^ round64(0, load64(p)), 27) * PRIME1 + PRIME2;
+    for (; p < end; p++)
+        hash = rotl(hash ^ (*p * PRIME3), 11) * PRIME1;
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/* Files and sections are kept in the same kind of table, which is shared
+ * between threads. Entries are never removed, and their output never
+ * changes once added, so it can be printed without holding the lock. */
+
+struct dedup_entry
+{
+    qword key;
+    off_t size;
+    unsigned file_index;
+    char *name;
+    char *output;
+    struct dedup_key digest;    /* sections only; key is the start of it */
+};
+
+struct dedup_table
+{
+    struct dedup_entry *entries;
+    size_t count, size;
+};
+
+static struct dedup_table files, sections;
+static pthread_mutex_t dedup_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Section output is only kept up to this much in total. */
+#define DEDUP_CACHE_MAX (256 << 20)
+static size_t cache_size;
+
+/* Zero marks an empty slot, so it's never used as a key. */
+static qword table_key(qword key)
+{
+    return key ? key : 1;
+}
+
+static struct dedup_entry *find_slot(struct dedup_table *table, qword key)
+{
+    size_t i;
+
+    for (i = key & (table->size - 1); table->entries[i].key; i = (i + 1) & (table->size - 1))
+    {
+        if (table->entries[i].key == key)
+            break;
+    }
+    return &table->entries[i];
+}
+
+static struct dedup_entry *find_entry(struct dedup_table *table, qword key)
+{
+    struct dedup_entry *entry;
+
+    if (!table->size)
+        return NULL;
+    entry = find_slot(table, table_key(key));
+    return entry->key ? entry : NULL;
+}
+
+static struct dedup_entry *add_entry(struct dedup_table *table, qword key)
+{
+    struct dedup_entry *entry;
+    size_t i;
+
+    if ((table->count + 1) * 2 > table->size)
+    {
+        struct dedup_entry *old = table->entries;
+        size_t old_size = table->size;
+
+        table->size = table->size ? table->size * 2 : 256;
+        table->entries = calloc(table->size, sizeof(*table->entries));
+        for (i = 0; i < old_size; i++)
+        {
+            if (old[i].key)
+                *find_slot(table, old[i].key) = old[i];
+        }
+        free(old);
+    }
+
+    entry = find_slot(table, table_key(key));
+    entry->key = table_key(key);
+    table->count++;
+    return entry;
+}
+
+/* Files */
+
+/* The hash is only 64 bits, and not hard to collide on purpose, so the file
+ * it matched is read back and compared before we say they're the same. */
+static int same_contents(const char *name, const byte *data, off_t size)
+{
+    byte buffer[65536];
+    off_t offset = 0;
+    ssize_t len;
+    int fd;
+
+    if ((fd = open(name, O_RDONLY)) < 0)
+        return 0;
+    while (offset < size && (len = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        if (len > size - offset || memcmp(buffer, data + offset, len))
+            break;
+        offset += len;
+    }
+    /* It must also not have grown since. */
+    if (offset == size && read(fd, buffer, 1) != 0)
+        offset = -1;
+    close(fd);
+    return offset == size;
+}
+
+char *dedup_file(const void *data, off_t size, const char *name)
+{
+    qword hash = hash_data(data, size, 0);
+    struct dedup_entry *entry;
+    char *ret = NULL;
+
+    pthread_mutex_lock(&dedup_lock);
+    if (!(entry = find_entry(&files, hash)) || entry->size != size)
+    {
+        /* A hash collision between files of different sizes is unlikely
+         * enough that we don't bother to keep both. */
+        if (!entry)
+            entry = add_entry(&files, hash);
+        else
+            free(entry->name);
+        entry->size = size;
+        entry->file_index = file_index;
+        entry->name = strdup(name);
+    }
+    else if (entry->file_index < file_index)
+        ret = strdup(entry->name);
+    else if (entry->file_index > file_index)
+    {
+        /* With -j, a later copy can get here first. It's dumped anyway, but
+         * the copies after us should refer to us, since we come first in the
+         * output (unless it's --unordered). */
+        free(entry->name);
+        entry->file_index = file_index;
+        entry->name = strdup(name);
+    }
+    pthread_mutex_unlock(&dedup_lock);
+
+    if (ret && !same_contents(ret, data, size))
+    {
+        free(ret);
+        ret = NULL;
+    }
+    return ret;
+}
+
+/* Sections */
+
+static __thread FILE *section_out;
+static __thread char *section_output;
+static __thread size_t section_size;
+
+static qword section_key(const struct dedup_key *key)
+{
+    qword ret;
+
+    memcpy(&ret, key->digest, sizeof(ret));
+    return ret;
+}
+
+int dedup_section_print(const struct dedup_key *key)
+{
+    struct dedup_entry *entry;
+    const char *output = NULL;
+    size_t size = 0;
+
+    /* The table may be resized as soon as we let go of it. */
+    pthread_mutex_lock(&dedup_lock);
+    if ((entry = find_entry(&sections, section_key(key)))
+            && !memcmp(&entry->digest, key, sizeof(*key)))
+    {
+        output = entry->output;
+        size = entry->size;
+    }
+    pthread_mutex_unlock(&dedup_lock);
+    if (!output)
+        return 0;
+    fwrite(output, 1, size, out);
+    return 1;
+}
+
+/* Collect the section's output in memory, and print it when it's done. */
+void dedup_section_begin(void)
+{
+    section_out = out;
+    if (!(out = open_memstream(&section_output, &section_size))) {
+        perror("Cannot allocate output buffer");
+        exit(1);
+    }
+}
+
+void dedup_section_end(const struct dedup_key *key)
+{
+    struct dedup_entry *entry;
+
+    fclose(out);
+    out = section_out;
+    fwrite(section_output, 1, section_size, out);
+
+    pthread_mutex_lock(&dedup_lock);
+    if (cache_size + section_size <= DEDUP_CACHE_MAX && !find_entry(&sections, section_key(key)))
+    {
+        entry = add_entry(&sections, section_key(key));
+        entry->digest = *key;
+        entry->size = section_size;
+        entry->output = section_output;
+        cache_size += section_size;
+        section_output = NULL;
+    }
+    pthread_mutex_unlock(&dedup_lock);
+    free(section_output);
+    section_output = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef __DEDUP_H
+#define __DEDUP_H
+
+#include "semblance.h"
+#include "sha256.h"
+
+/* With --dedup, a file that's identical to one we've already dumped isn't
+ * dumped again; we just say which file it's the same as. The output of code
+ * sections is also kept, and reused for a section whose output would be the
+ * same, even if the rest of the file differs. */
+
+extern int dedup;
+
+/* A fast non-cryptographic hash. Pass the hash of the previous piece as the
+ * seed to hash several pieces together. */
+extern qword hash_data(const void *data, size_t len, qword seed);
+
+/* Returns the name of an earlier file with the same contents, which the
+ * caller must free, or NULL if there isn't one. */
+extern char *dedup_file(const void *data, off_t size, const char *name);
+
+/* Sections are looked up by the SHA-256 of whatever their output depends on,
+ * since another file's output is printed as if it were this one's. */
+struct dedup_key
+{
+    byte digest[SHA256_DIGEST_SIZE];
+};
+
+/* Print a section's output from the cache, if it's there, and return 1.
+ * Otherwise return 0; the caller should then print it between
+ * dedup_section_begin() and dedup_section_end(), which adds it. */
+extern int dedup_section_print(const struct dedup_key *key);
+extern void dedup_section_begin(void);
+extern void dedup_section_end(const struct dedup_key *key);
+
+#endif /* __DEDUP_H */
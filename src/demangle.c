@@ -0,0 +1,584 @@
+/*
+ * Demangling C++ names
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "semblance.h"
+#include "arena.h"
+#include "demangle.h"
+
+/* The output is built in a growable buffer, so that appending is linear. */
+struct strbuf {
+    char *data;
+    size_t len;
+    size_t size;
+};
+
+static void strbuf_reserve(struct strbuf *buf, size_t len)
+{
+    if (buf->len + len + 1 > buf->size)
+    {
+        while (buf->len + len + 1 > buf->size)
+            buf->size = buf->size ? buf->size * 2 : 256;
+        buf->data = realloc(buf->data, buf->size);
+    }
+}
+
+static void strbuf_append(struct strbuf *buf, const char *str, size_t len)
+{
+    strbuf_reserve(buf, len);
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = 0;
+}
+
+static void strbuf_puts(struct strbuf *buf, const char *str)
+{
+    strbuf_append(buf, str, strlen(str));
+}
+
+static void strbuf_putc(struct strbuf *buf, char c)
+{
+    strbuf_append(buf, &c, 1);
+}
+
+struct demangler {
+    const char *func;
+    int flat;
+    int failed;
+    struct strbuf buf;
+
+    /* Back-references to names are pointers into func; back-references to
+     * types are spans of the output buffer. */
+    struct {
+        const char *str;
+        size_t len;
+    } names[10];
+    unsigned name_count;
+
+    struct {
+        size_t start;
+        size_t len;
+    } types[10];
+    unsigned type_count;
+};
+
+static int fail(struct demangler *d)
+{
+    d->failed = 1;
+    return 0;
+}
+
+static void add_name(struct demangler *d, const char *str, size_t len)
+{
+    if (d->name_count < 10)
+    {
+        d->names[d->name_count].str = str;
+        d->names[d->name_count].len = len;
+        d->name_count++;
+    }
+}
+
+static int demangle_protection(struct demangler *d, const char *start, char *prot)
+{
+    struct strbuf *buf = &d->buf;
+    const char *end;
+
+    if (*start >= 'A' && *start <= 'V') {
+        if ((*start-'A') & 2)
+            strbuf_puts(buf, "static ");
+        if ((*start-'A') & 4)
+            strbuf_puts(buf, "virtual ");
+        if (!((*start-'A') & 1) && !d->flat)
+            strbuf_puts(buf, "near ");
+        if (((*start-'A') & 24) == 0)
+            strbuf_puts(buf, "private ");
+        else if (((*start-'A') & 24) == 8)
+            strbuf_puts(buf, "protected ");
+        else if (((*start-'A') & 24) == 16)
+            strbuf_puts(buf, "public ");
+        *prot = *start;
+    } else if (*start == 'Y') {
+        if (!d->flat)
+            strbuf_puts(buf, "near ");
+    } else if (*start == 'Z') {
+        /* normally we'd mark far and not near, but most functions which
+         * are going to have an exported name will be far. */
+    } else if (*start == 'X' && !d->flat) {
+        /* It's not clear what this means, but it always seems to be
+         * followed by either a number, or a string of text and then @. */
+        *prot = 'V'; /* just pretend that for now */
+        if (start[1] >= '0' && start[1] <= '9') {
+            strbuf_puts(buf, "(X");
+            strbuf_putc(buf, start[1]);
+            strbuf_puts(buf, ") ");
+            return 2;
+        } else {
+            if (!(end = strchr(start, '@'))) return fail(d);
+            return (end+1)-start;
+        }
+    } else if (*start == '_' && start[1] != '$' && !d->flat) {
+        /* Same as above, but there is an extra character first (which
+         * is often V, so is likely to be the protection/etc), and then
+         * a number (often 7 or 3). */
+        if (!start[1] || !start[2]) return fail(d);
+        demangle_protection(d, start+1, prot);
+        if (start[3] >= '0' && start[3] <= '9') {
+            strbuf_puts(buf, "(_");
+            strbuf_putc(buf, start[2]);
+            strbuf_putc(buf, start[3]);
+            strbuf_puts(buf, ") ");
+            return 4;
+        } else {
+            if (!(end = strchr(start, '@'))) return fail(d);
+            return (end+1)-start;
+        }
+    } else {
+        if (!d->flat)
+            warn("Unknown modifier %c for function %s\n", *start, d->func);
+        return 0;
+    }
+    return 1;
+}
+
+static const char *int_types[] = {
+    "signed char",      /* C */
+    "char",             /* D */
+    "unsigned char",    /* E */
+    "short",            /* F */
+    "unsigned short",   /* G */
+    "int",              /* H */
+    "unsigned int",     /* I */
+    "long",             /* J */
+    "unsigned long",    /* K */
+};
+
+/* Extended types, in 32- and 64-bit images. */
+static const char *ext_types[] = {
+    "__int8",           /* _D */
+    "unsigned __int8",  /* _E */
+    "__int16",          /* _F */
+    "unsigned __int16", /* _G */
+    "__int32",          /* _H */
+    "unsigned __int32", /* _I */
+    "__int64",          /* _J */
+    "unsigned __int64", /* _K */
+    NULL,               /* _L */
+    NULL,               /* _M */
+    "bool",             /* _N */
+    NULL,               /* _O */
+    NULL,               /* _P */
+    NULL,               /* _Q */
+    NULL,               /* _R */
+    NULL,               /* _S */
+    NULL,               /* _T */
+    NULL,               /* _U */
+    NULL,               /* _V */
+    "wchar_t",          /* _W */
+};
+
+/* Print a qualified name, which is stored innermost first, as in
+ * "name@namespace@@". Returns the number of characters processed. */
+static int demangle_qualified_name(struct demangler *d, const char *name)
+{
+    const char *parts[16], *p = name, *end;
+    size_t lens[16];
+    int count = 0;
+
+    while (*p != '@')
+    {
+        if (count == 16) return fail(d);
+
+        if (*p >= '0' && *p <= '9') {
+            if (*p - '0' >= d->name_count) return fail(d);
+            parts[count] = d->names[*p - '0'].str;
+            lens[count] = d->names[*p - '0'].len;
+            p++;
+        } else {
+            if (*p == '?' || !(end = strchr(p, '@')) || end == p) return fail(d);
+            parts[count] = p;
+            lens[count] = end - p;
+            add_name(d, p, end - p);
+            p = end + 1;
+        }
+        count++;
+    }
+
+    while (count--)
+    {
+        strbuf_append(&d->buf, parts[count], lens[count]);
+        if (count) strbuf_puts(&d->buf, "::");
+    }
+    return (p+1)-name;
+}
+
+/* Returns the number of characters processed. */
+static int demangle_type(struct demangler *d, const char *type)
+{
+    struct strbuf *buf = &d->buf;
+
+    if (*type >= 'C' && *type <= 'K') {
+        strbuf_puts(buf, int_types[*type-'C']);
+        strbuf_putc(buf, ' ');
+        return 1;
+    }
+
+    if (d->flat) {
+        switch (*type) {
+        case 'A':
+        case 'P':
+        case 'Q':
+        case 'R':
+        case 'S':
+        {
+            const char *p = type + 1;
+            int cv, ret;
+
+            if (*p == 'E') p++;     /* __ptr64 */
+            if (*p < 'A' || *p > 'D') return fail(d);
+            cv = *p - 'A';
+            if (cv & 1)
+                strbuf_puts(buf, "const ");
+            if (cv & 2)
+                strbuf_puts(buf, "volatile ");
+            p++;
+            if (!(ret = demangle_type(d, p))) return fail(d);
+            strbuf_puts(buf, (*type == 'A') ? "&" : "*");
+            if (*type == 'Q' || *type == 'S')
+                strbuf_puts(buf, " const");
+            if (*type == 'R' || *type == 'S')
+                strbuf_puts(buf, " volatile");
+            return (p-type) + ret;
+        }
+        case 'M': strbuf_puts(buf, "float "); return 1;
+        case 'N': strbuf_puts(buf, "double "); return 1;
+        case 'O': strbuf_puts(buf, "long double "); return 1;
+        case 'T':
+        case 'U':
+        case 'V':
+        {
+            int ret;
+            if (!(ret = demangle_qualified_name(d, type+1))) return 0;
+            strbuf_putc(buf, ' ');
+            return ret+1;
+        }
+        case 'W':
+        {
+            int ret;
+            if (type[1] != '4') return fail(d);
+            strbuf_puts(buf, "enum ");
+            if (!(ret = demangle_qualified_name(d, type+2))) return 0;
+            strbuf_putc(buf, ' ');
+            return ret+2;
+        }
+        case 'X': strbuf_puts(buf, "void "); return 1;
+        case '_':
+            if (type[1] < 'D' || type[1] > 'W' || !ext_types[type[1]-'D']) return fail(d);
+            strbuf_puts(buf, ext_types[type[1]-'D']);
+            strbuf_putc(buf, ' ');
+            return 2;
+        default: return fail(d);
+        }
+    }
+
+    switch (*type) {
+    case 'A':
+    case 'P':
+    {
+        int ret;
+        if (!type[1]) return fail(d);
+        if ((type[1]-'A') & 1)
+            strbuf_puts(buf, "const ");
+        if ((type[1]-'A') & 2)
+            strbuf_puts(buf, "volatile ");
+        ret = demangle_type(d, type+2);
+        if (!((type[1]-'A') & 4))
+            strbuf_puts(buf, "near ");
+        strbuf_puts(buf, (*type == 'A') ? "&" : "*");
+        return ret+2;
+    }
+    case 'M': strbuf_puts(buf, "float "); return 1;
+    case 'N': strbuf_puts(buf, "double "); return 1;
+    case 'U':
+    case 'V':
+    {
+        const char *first, *end;
+        size_t len;
+
+        if (type[1] >= '0' && type[1] <= '9')
+        {
+            if (type[1] - '0' >= d->name_count) return fail(d);
+            strbuf_append(buf, d->names[type[1] - '0'].str, d->names[type[1] - '0'].len);
+            strbuf_putc(buf, ' ');
+            return 3;
+        }
+
+        /* These represent structs (U) or types (V), but the name given
+         * doesn't seem to need a qualifier. */
+        /* something can go between the at signs, but what does it mean? */
+        if (!(first = strchr(type, '@')) || !(end = strchr(first+1, '@')))
+            return fail(d);
+        len = end-(type+1);
+        if (end[-1] == '@')
+            len--;
+        strbuf_append(buf, type+1, len);
+        add_name(d, type+1, len);
+        strbuf_putc(buf, ' ');
+        return (end+1)-type;
+    }
+    case 'X': strbuf_puts(buf, "void "); return 1;
+    default: return 0;
+    }
+}
+
+/* Demangle a C++ function name. The scheme used in 16-bit images seems to be
+ * mostly older than any documented, but I was able to find documentation that
+ * is at least close in Agner Fog's manual. */
+static void demangle_func(struct demangler *d)
+{
+    struct strbuf *buf = &d->buf;
+    const char *func = d->func;
+    const char *p, *start, *end, *at;
+    char prot = 0;
+    int len, cv = -1;
+
+    if (!(at = strstr(func, "@@")))
+        return (void)fail(d);
+
+    /* First populate the known names up to the function name. */
+    for (p = func + 1; *p != '@'; p = end + 1)
+    {
+        end = strchr(p, '@');
+        if (d->flat && (end == p || memchr(p, '?', end - p) || memchr(p, '$', end - p)))
+            return (void)fail(d);
+        add_name(d, p, end - p);
+    }
+
+    /* Figure out the modifiers and calling convention. */
+    p = at + 2;
+    len = demangle_protection(d, p, &prot);
+    if (!len || d->failed) {
+        fail(d);
+        return;
+    }
+    p += len;
+
+    if (prot >= 'A' && prot <= 'V' && !((prot-'A') & 2)) {
+        if (d->flat) {
+            /* the qualifiers of "this" */
+            if (*p == 'E') p++;
+            if (*p < 'A' || *p > 'D')
+                return (void)fail(d);
+            cv = *p - 'A';
+        } else {
+            /* The next one seems to always be E or F. No idea why. */
+            if (*p != 'E' && *p != 'F')
+                warn("Unknown modifier %c for function %s\n", *p, func);
+        }
+        if (!*p) return (void)fail(d);
+        p++;
+    }
+
+    /* This should mark the calling convention. Always seems to be A,
+     * but this corroborates the function body which uses CDECL. */
+    if (d->flat) {
+        if (*p == 'C' || *p == 'D') strbuf_puts(buf, "__pascal ");
+        else if (*p == 'G' || *p == 'H') strbuf_puts(buf, "__stdcall ");
+        else if (*p == 'I' || *p == 'J') strbuf_puts(buf, "__fastcall ");
+        else if (*p < 'A' || *p > 'F') return (void)fail(d);
+    } else {
+        if (*p == 'A'); /* __cdecl */
+        else if (*p == 'C') strbuf_puts(buf, "__pascal ");
+        else warn("Unknown calling convention %c for function %s\n", *p, func);
+    }
+
+    /* This marks the return value. */
+    if (!*p) return (void)fail(d);
+    p++;
+    if (d->flat && p[0] == '?' && p[1] >= 'A' && p[1] <= 'D')
+        p += 2;     /* storage class of a returned object */
+    len = demangle_type(d, p);
+    if (d->failed) return;
+    if (!len) {
+        warn("Unknown return type %c for function %s\n", *p, func);
+        len = 1;
+    }
+    p += len;
+
+    /* Get the classname. This is in reverse order, so
+     * find the first @@ and work backwards from there. */
+    start = end = at;
+    while (1) {
+        start--;
+        while (*start != '?' && *start != '@') start--;
+        strbuf_append(buf, start+1, end-(start+1));
+        if (*start == '?') break;
+        strbuf_puts(buf, "::");
+        end = start;
+    }
+
+    /* Print the arguments. */
+    if (*p == 'X') {
+        strbuf_puts(buf, "(void)");
+    } else {
+        strbuf_putc(buf, '(');
+        while (*p != '@') {
+            if (!*p) return (void)fail(d);
+
+            if (d->flat && *p == 'Z') {
+                strbuf_puts(buf, "..., ");
+                break;
+            }
+
+            if (*p >= '0' && *p <= '9') {
+                if (*p - '0' >= d->type_count) return (void)fail(d);
+                strbuf_reserve(buf, d->types[*p - '0'].len);
+                strbuf_append(buf, buf->data + d->types[*p - '0'].start, d->types[*p - '0'].len);
+                p++;
+            } else {
+                size_t type = buf->len;
+                len = demangle_type(d, p);
+                if (d->failed) return;
+                if (buf->data[buf->len-1] == ' ')
+                    buf->data[--buf->len] = 0;
+                if (len > 1 && d->type_count < 10) {
+                    d->types[d->type_count].start = type;
+                    d->types[d->type_count].len = buf->len - type;
+                    d->type_count++;
+                } else if (!len) {
+                    warn("Unknown argument type %c for function %s\n", *p, func);
+                    len = 1;
+                }
+                p += len;
+            }
+            strbuf_puts(buf, ", ");
+        }
+        if (buf->len < 2) return (void)fail(d);
+        buf->data[buf->len-2] = ')';
+        buf->data[--buf->len] = 0;
+    }
+
+    if (cv > 0) {
+        if (cv & 1)
+            strbuf_puts(buf, " const");
+        if (cv & 2)
+            strbuf_puts(buf, " volatile");
+    }
+}
+
+/* Results are remembered, since the same names tend to come up again and
+ * again: the same modules are imported by every file. Each thread keeps its
+ * own table, so no locking is needed. */
+
+struct memo_entry {
+    const char *mangled;
+    const char *demangled;
+    int flat;
+};
+
+static __thread struct memo_entry *memo;
+static __thread unsigned memo_size, memo_count;
+static __thread struct arena memo_arena;
+static __thread struct strbuf scratch;
+
+static unsigned hash_string(const char *str, int flat)
+{
+    unsigned hash = 2166136261u ^ flat;
+    while (*str)
+        hash = (hash ^ (byte)*str++) * 16777619u;
+    return hash;
+}
+
+static struct memo_entry *memo_lookup(const char *name, int flat)
+{
+    unsigned h = hash_string(name, flat) & (memo_size - 1);
+
+    while (memo[h].mangled && (memo[h].flat != flat || strcmp(memo[h].mangled, name)))
+        h = (h + 1) & (memo_size - 1);
+    return &memo[h];
+}
+
+static void memo_grow(void)
+{
+    struct memo_entry *old = memo;
+    unsigned old_size = memo_size, i;
+
+    memo_size = memo_size ? memo_size * 2 : 256;
+    memo = calloc(memo_size, sizeof(*memo));
+    for (i = 0; i < old_size; i++)
+    {
+        if (old[i].mangled)
+            *memo_lookup(old[i].mangled, old[i].flat) = old[i];
+    }
+    free(old);
+}
+
+const char *demangle(const char *name, int flat)
+{
+    struct demangler d = {0};
+    struct memo_entry *entry;
+    size_t len;
+
+    /* TODO: constructor/destructor */
+    if (name[0] != '?' || name[1] == '?')
+        return name;
+
+    if (memo_count * 4 >= memo_size * 3)
+        memo_grow();
+    entry = memo_lookup(name, flat);
+    if (entry->mangled)
+        return entry->demangled;
+
+    len = strlen(name);
+    entry->mangled = arena_strndup(&memo_arena, name, len);
+    entry->flat = flat;
+    memo_count++;
+
+    d.func = entry->mangled;
+    d.flat = flat;
+    d.buf = scratch;
+    d.buf.len = 0;
+    strbuf_reserve(&d.buf, 0);
+    d.buf.data[0] = 0;
+
+    demangle_func(&d);
+
+    if (d.failed)
+        entry->demangled = entry->mangled;
+    else
+        entry->demangled = arena_strndup(&memo_arena, d.buf.data, d.buf.len);
+
+    scratch = d.buf;
+    return entry->demangled;
+}
+
+void demangle_thread_end(void)
+{
+    free(memo);
+    memo = NULL;
+    memo_size = memo_count = 0;
+    arena_free(&memo_arena);
+    free(scratch.data);
+    memset(&scratch, 0, sizeof(scratch));
+}
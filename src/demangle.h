@@ -0,0 +1,13 @@
+#ifndef __DEMANGLE_H
+#define __DEMANGLE_H
+
+/* Demangle a C++ name. If flat is set, the name comes from a 32- or 64-bit
+ * image, so near and far are meaningless; otherwise it's from a 16-bit image.
+ * Names that aren't mangled, or that we can't parse, are returned unchanged.
+ * The result lives until demangle_thread_end() is called on the same thread. */
+extern const char *demangle(const char *name, int flat);
+
+/* Forget the names this thread has demangled, and free their memory. */
+extern void demangle_thread_end(void);
+
+#endif /* __DEMANGLE_H */
@@ -20,8 +20,11 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -30,57 +33,296 @@
 #include <unistd.h>
 
 #include "semblance.h"
+#include "cache.h"
+#include "dedup.h"
+#include "demangle.h"
+#include "imphash.h"
+#include "index.h"
+#include "input.h"
+#include "prefetch.h"
+#include "record.h"
+#include "server.h"
+#include "where.h"
 
-byte *map;
+/* Parse a size like 64k or 2M. */
+static int parse_size(const char *str, off_t *size)
+{
+    char *end;
 
-word mode;
-word opts;
-char **resource_filters;
-unsigned resource_filters_count;
-enum asm_syntax asm_syntax;
+    *size = strtoull(str, &end, 10);
+    switch (*end)
+    {
+    case 'k': case 'K': *size <<= 10; end++; break;
+    case 'm': case 'M': *size <<= 20; end++; break;
+    case 'g': case 'G': *size <<= 30; end++; break;
+    }
+    return end != str && !*end;
+}
+
+static int parse_map_options(const char *str)
+{
+    char *copy = strdup(str), *option, *value;
+    int ret = 1;
+
+    for (option = strtok(copy, ","); option && ret; option = strtok(NULL, ","))
+    {
+        if ((value = strchr(option, '=')))
+            *value++ = 0;
 
-const char *program_name;
+        if (!strcmp(option, "advise") && !value)
+            map_advise = 1;
+        else if (!strcmp(option, "dontneed") && !value)
+            map_dontneed = 1;
+        else if (!strcmp(option, "populate")) {
+            map_populate_max = 1 << 20;
+            if (value && !parse_size(value, &map_populate_max))
+                ret = 0;
+        } else if (!strcmp(option, "huge")) {
+            map_huge_min = 64 << 20;
+            if (value && !parse_size(value, &map_huge_min))
+                ret = 0;
+        } else
+            ret = 0;
+    }
+
+    free(copy);
+    return ret;
+}
+
+/* Modes which print at most a line for each file, or a record on each line,
+ * and no file headers. */
+static int summary_mode(void)
+{
+    return mode == CLUSTER || mode == VERSIONINFO || mode == TRIAGE
+            || output_format != FORMAT_TEXT;
+}
 
 static void dump_file(char *file){
     struct stat st;
-    word magic;
-    off_t offset = 0;
+    char *original;
     int fd;
 
     if ((fd = open(file, O_RDONLY)) < 0) {
-        perror("Cannot open %s");
+        fprintf(stderr, "Cannot open %s: %s\n", file, strerror(errno));
+        return;
+    }
+
+    if (mode == TRIAGE) {
+        file_name = file;
+        triage_file(fd);
+        close(fd);
         return;
     }
 
     if (fstat(fd, &st) < 0)
     {
-        perror("Cannot stat %s");
+        fprintf(stderr, "Cannot stat %s: %s\n", file, strerror(errno));
+        close(fd);
         return;
     }
 
-    if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    /* Too small to have a header, and mapping an empty file fails. */
+    if (st.st_size < 0x40)
     {
-        perror("Cannot map %s");
+        fprintf(stderr, "%s: File format not recognized\n", file);
+        close(fd);
         return;
     }
 
-    magic = read_word(0);
-
-    printf("File: %s\n", file);
-    if (magic == 0x5a4d){ /* MZ */
-        offset = read_dword(0x3c);
-        magic = read_word(offset);
+    if ((map = map_file(fd, st.st_size)) == MAP_FAILED)
+    {
+        fprintf(stderr, "Cannot map %s: %s\n", file, strerror(errno));
+        close(fd);
+        return;
+    }
+    map_size = st.st_size;
+    map_fd = fd;
+    map_error = 0;
 
-        if (magic == 0x4550)
-            dumppe(offset);
-        else if (magic == 0x454e)
-            dumpne(offset);
-        else
-            dumpmz();
-    } else
+    file_name = file;
+    if (!summary_mode())
+        fprintf(out, "File: %s\n", file);
+    record_file_begin();
+    if (dedup && (original = dedup_file(map, map_size, file))) {
+        if (output_format != FORMAT_TEXT) {
+            record_begin("duplicate");
+            record_string("file", file);
+            record_string("of", original);
+            record_end();
+        } else
+            fprintf(out, "Identical to %s.\n", original);
+        free(original);
+    } else if (!dump_map())
         fprintf(stderr, "File format not recognized\n");
 
-    return;
+    if (map_error)
+        fprintf(stderr, "%s: File is truncated or corrupt\n", file);
+
+    unmap_file(map, map_size);
+    close(fd);
+    map = NULL;
+    map_size = 0;
+    map_fd = -1;
+}
+
+/* With -j, files are dumped by a pool of threads. Each file's output is
+ * collected in memory, and printed from the main thread, either in the order
+ * the files were given or (with --unordered) in the order they finish.
+ * --index also dumps files this way, even with one thread, since we can only
+ * tell where a file's output ends up once it's printed.
+ *
+ * Only a few files are in flight at once: each job takes a slot in a ring, and
+ * the slot is only given to a new file once its output has been printed. This
+ * bounds the memory and descriptors we use, however many files there are. */
+
+enum job_state {
+    JOB_FREE,
+    JOB_RUNNING,
+    JOB_DONE,
+};
+
+struct job {
+    char *file;
+    char *output;
+    size_t size;
+    struct listing_index index;
+    enum job_state state;
+};
+
+static unsigned thread_count;
+static int unordered;
+static unsigned prefetch_count;
+
+static int server_mode;
+static const char *server_path;
+
+/* How much we've printed to stdout, for --index. */
+static off_t output_offset;
+
+static struct job *jobs;
+static unsigned job_slots;
+static unsigned next_job;   /* index of the next file to start */
+static int no_more_files;
+static unsigned *finished, finished_head, finished_tail;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_free = PTHREAD_COND_INITIALIZER;
+
+static void *dump_thread(void *arg)
+{
+    struct job *job;
+    unsigned index;
+    char *file;
+
+    options_restore(arg);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&job_lock);
+        while (!no_more_files && jobs[next_job % job_slots].state != JOB_FREE)
+            pthread_cond_wait(&job_free, &job_lock);
+        if (no_more_files || !(file = prefetch_next())) {
+            no_more_files = 1;
+            pthread_cond_broadcast(&job_free);
+            pthread_cond_signal(&job_done);
+            pthread_mutex_unlock(&job_lock);
+            record_thread_end();
+            demangle_thread_end();
+            return NULL;
+        }
+        index = next_job++;
+        job = &jobs[index % job_slots];
+        job->file = file;
+        job->state = JOB_RUNNING;
+        pthread_mutex_unlock(&job_lock);
+
+        file_index = index;
+        if (index_enabled())
+            listing_index = &job->index;
+        if (!(out = open_memstream(&job->output, &job->size))) {
+            perror("Cannot allocate output buffer");
+            exit(1);
+        }
+        dump_file(file);
+        fclose(out);
+
+        pthread_mutex_lock(&job_lock);
+        job->state = JOB_DONE;
+        finished[finished_tail++ % job_slots] = index;
+        pthread_cond_signal(&job_done);
+        pthread_mutex_unlock(&job_lock);
+    }
+}
+
+static void dump_files_parallel(void)
+{
+    struct options options;
+    pthread_t *threads;
+    struct job *job;
+    unsigned i, printed;
+    int ret;
+
+    job_slots = thread_count * 4;
+    jobs = calloc(job_slots, sizeof(*jobs));
+    finished = malloc(job_slots * sizeof(*finished));
+    next_job = finished_head = finished_tail = 0;
+    no_more_files = 0;
+
+    options_save(&options);
+    threads = malloc(thread_count * sizeof(*threads));
+    for (i = 0; i < thread_count; i++)
+    {
+        if ((ret = pthread_create(&threads[i], NULL, dump_thread, &options))) {
+            fprintf(stderr, "Cannot create thread: %s\n", strerror(ret));
+            exit(1);
+        }
+    }
+
+    for (printed = 0; ; printed++)
+    {
+        pthread_mutex_lock(&job_lock);
+        if (unordered) {
+            while (finished_head == finished_tail && !(no_more_files && printed == next_job))
+                pthread_cond_wait(&job_done, &job_lock);
+            if (finished_head == finished_tail) {
+                pthread_mutex_unlock(&job_lock);
+                break;
+            }
+            job = &jobs[finished[finished_head++ % job_slots] % job_slots];
+        } else {
+            job = &jobs[printed % job_slots];
+            while (!(printed < next_job && job->state == JOB_DONE) && !(no_more_files && printed == next_job))
+                pthread_cond_wait(&job_done, &job_lock);
+            if (printed == next_job) {
+                pthread_mutex_unlock(&job_lock);
+                break;
+            }
+        }
+        pthread_mutex_unlock(&job_lock);
+
+        if (printed && !summary_mode()) {
+            fputs("\n\n", out);
+            output_offset += 2;
+        }
+        if (index_enabled())
+            index_write(&job->index, job->file, output_offset);
+        fwrite(job->output, 1, job->size, out);
+        output_offset += job->size;
+        free(job->output);
+        free(job->file);
+
+        pthread_mutex_lock(&job_lock);
+        job->state = JOB_FREE;
+        pthread_cond_broadcast(&job_free);
+        pthread_mutex_unlock(&job_lock);
+    }
+
+    for (i = 0; i < thread_count; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    free(finished);
+    free(jobs);
 }
 
 static const char help_message[] =
@@ -95,6 +337,7 @@ static const char help_message[] =
 "\t-f, --file-headers                   Print contents of the file header.\n"
 "\t-h, --help                           Display this help message.\n"
 "\t-i, --imports                        Print imported modules.\n"
+"\t-j, --jobs=N                         Dump N files at once.\n"
 "\t-M, --disassembler-options=[...]     Extended options for disassembly.\n"
 "\t\tatt        Alias for `gas'.\n"
 "\t\tgas        Use GAS syntax for disassembly.\n"
@@ -102,12 +345,41 @@ static const char help_message[] =
 "\t\tmasm       Use MASM syntax for disassembly.\n"
 "\t\tnasm       Use NASM syntax for disassembly.\n"
 "\t-o, --specfile                       Create a specfile from exports.\n"
+"\t-r, --recursive=DIR                  Dump every file under DIR.\n"
 "\t-s, --full-contents                  Display full contents of all sections.\n"
 "\t-v, --version                        Print the version number of semblance.\n"
 "\t-x, --all-headers                    Print all headers.\n"
 "\t--no-show-addresses                  Don't print instruction addresses.\n"
 "\t--no-show-raw-insn                   Don't print raw instruction hex code.\n"
 "\t--pe-rel-addr=[y/n]                  Use relative addresses for PE files.\n"
+"\t--verify-checksum                    Verify the image checksum.\n"
+"\t--image-hash                         Print the Authenticode hash of PE images.\n"
+"\t--import-hash                        Print a hash of the set of imported functions.\n"
+"\t--cluster-imports                    Group files by the hash of their imports.\n"
+"\t--extract-resources=DIR              Write resources (filtered by -a) to files in DIR.\n"
+"\t--version-info                       Print a one-line summary of version information.\n"
+"\t--triage                             Print a one-line summary of the file headers.\n"
+"\t--map=[...]                          Options for how files are mapped, separated by commas.\n"
+"\t\tadvise          Advise random access while scanning and sequential while printing.\n"
+"\t\tpopulate[=SIZE] Read files up to SIZE (default 1M) in when mapping them.\n"
+"\t\thuge[=SIZE]     Use huge pages for files of at least SIZE (default 64M).\n"
+"\t\tdontneed        Drop each section from memory after printing it.\n"
+"\t--unordered                          With -j, print each file as soon as it is done.\n"
+"\t--files-from=FILE                    Dump the files named in FILE (- for stdin), separated by nulls.\n"
+"\t--prefetch=N                         Start reading the next N files while dumping.\n"
+"\t--format=[...]                       How to print what's dumped.\n"
+"\t\ttext            Print a listing (the default).\n"
+"\t\tjsonl           Print one JSON record per line.\n"
+"\t\tbinary          Print records in a compact binary format.\n"
+"\t--dedup                              Don't dump files or code sections again if they're the same as before.\n"
+"\t--cache-dir=DIR                      Keep what we learn from scanning code in DIR, and reuse it.\n"
+"\t--server[=SOCKET]                    Dump files as requests for them come in on stdin, or on SOCKET.\n"
+"\t--server-cache=SIZE                  Keep up to SIZE (default 256M) of scan results in memory.\n"
+"\t--index=FILE                         Write an index of where each file, section, and function starts in the output to FILE.\n"
+"\t--where=PREDICATE                    Only print instructions matching PREDICATE, and any others given.\n"
+"\t\tcalls-import    Calls or jumps to an imported function.\n"
+"\t\tmnemonic=NAME   Instructions named NAME.\n"
+"\t\treferences=ADDR Instructions with ADDR (hex, or SEG:OFF) as an operand or target.\n"
 ;
 
 static const struct option long_options[] = {
@@ -121,28 +393,99 @@ static const struct option long_options[] = {
 //  {"gas",                     no_argument,        NULL, 'G'},
     {"help",                    no_argument,        NULL, 'h'},
     {"imports",                 no_argument,        NULL, 'i'},
+    {"jobs",                    required_argument,  NULL, 'j'},
 //  {"masm",                    no_argument,        NULL, 'I'}, /* for "Intel" */
     {"disassembler-options",    required_argument,  NULL, 'M'},
 //  {"nasm",                    no_argument,        NULL, 'N'},
     {"specfile",                no_argument,        NULL, 'o'},
+    {"recursive",               required_argument,  NULL, 'r'},
     {"full-contents",           no_argument,        NULL, 's'},
     {"version",                 no_argument,        NULL, 'v'},
     {"all-headers",             no_argument,        NULL, 'x'},
     {"no-show-raw-insn",        no_argument,        NULL, NO_SHOW_RAW_INSN},
     {"no-prefix-addresses",     no_argument,        NULL, NO_SHOW_ADDRESSES},
     {"pe-rel-addr",             required_argument,  NULL, 0x80},
+    {"verify-checksum",         no_argument,        NULL, 0x81},
+    {"image-hash",              no_argument,        NULL, 0x82},
+    {"import-hash",             no_argument,        NULL, 0x83},
+    {"cluster-imports",         no_argument,        NULL, 0x84},
+    {"extract-resources",       required_argument,  NULL, 0x85},
+    {"version-info",            no_argument,        NULL, 0x86},
+    {"unordered",               no_argument,        NULL, 0x87},
+    {"files-from",              required_argument,  NULL, 0x88},
+    {"prefetch",                required_argument,  NULL, 0x89},
+    {"triage",                  no_argument,        NULL, 0x8a},
+    {"map",                     required_argument,  NULL, 0x8b},
+    {"format",                  required_argument,  NULL, 0x8c},
+    {"index",                   required_argument,  NULL, 0x8d},
+    {"dedup",                   no_argument,        NULL, 0x8e},
+    {"cache-dir",               required_argument,  NULL, 0x8f},
+    {"server",                  optional_argument,  NULL, 0x90},
+    {"server-cache",            required_argument,  NULL, 0x91},
+    {"where",                   required_argument,  NULL, 0x92},
     {0}
 };
 
-int main(int argc, char *argv[]){
-    int opt;
+/* Options which set up the server, or which collect something across all of
+ * the files dumped, can't be given in a server request. */
+static int server_only_option(int opt)
+{
+    return opt == 0x84 || opt == 0x89 || opt == 0x8b || opt == 0x8d || opt == 0x8e
+            || opt == 0x8f || opt == 0x90 || opt == 0x91;
+}
+
+static void reset_options(void)
+{
+    unsigned i;
 
     mode = 0;
     opts = 0;
     asm_syntax = NASM;
-    program_name = argv[0];
+    output_format = FORMAT_TEXT;
+    pe_rel_addr = -1;
+    for (i = 0; i < resource_filters_count; i++)
+        free(resource_filters[i]);
+    free(resource_filters);
+    resource_filters = NULL;
+    resource_filters_count = 0;
+    extract_dir = NULL;
+    where_free(where_clauses, where_count);
+    where_clauses = NULL;
+    where_count = 0;
+    thread_count = 0;
+    unordered = 0;
+    input_reset();
+}
+
+/* --specfile, --cluster-imports, --version-info, and --triage each replace
+ * the whole dump with one thing, so they can't be given with each other or
+ * with any other option that chooses what to dump. */
+static int set_only_mode(word only_mode, word *chosen)
+{
+    if (mode && mode != only_mode) {
+        fprintf(stderr, "--specfile, --cluster-imports, --version-info, and --triage can't be used with each other or with other options that choose what to dump.\n");
+        return 0;
+    }
+    mode = *chosen = only_mode;
+    return 1;
+}
+
+/* Parse the options, and queue up the files to dump. Returns -1 to go on and
+ * dump them, or else the status to exit with. */
+static int parse_options(int argc, char *argv[], int request){
+    unsigned input_count = 0;
+    word only_mode = 0;
+    int opt, long_index;
+
+    /* Start over, for each server request. */
+    optind = 0;
+
+    while ((opt = getopt_long(argc, argv, "a::cCdDefhij:M:or:svx", long_options, &long_index)) >= 0){
+        if (request && server_only_option(opt)) {
+            fprintf(stderr, "--%s can't be used in a server request.\n", long_options[long_index].name);
+            return 1;
+        }
 
-    while ((opt = getopt_long(argc, argv, "a::cCdDefhiM:osvx", long_options, NULL)) >= 0){
         switch (opt) {
         case NO_SHOW_RAW_INSN:
             opts |= NO_SHOW_RAW_INSN;
@@ -180,11 +523,22 @@ int main(int argc, char *argv[]){
             mode |= DUMPHEADER;
             break;
         case 'h': /* help */
-            printf(help_message);
+            fputs(help_message, out);
             return 0;
         case 'i': /* imports */
             mode |= DUMPIMPORT;
             break;
+        case 'j': /* jobs */
+        {
+            char *end;
+            unsigned long n = strtoul(optarg, &end, 10);
+            if (*end || !n || n > 1024) {
+                fprintf(stderr, "Invalid number of jobs `%s'.\n", optarg);
+                return 1;
+            }
+            thread_count = n;
+            break;
+        }
         case 'M': /* additional options */
             if (!strcmp(optarg, "att") || !strcmp(optarg, "gas"))
                 asm_syntax = GAS;
@@ -198,10 +552,15 @@ int main(int argc, char *argv[]){
             }
             break;
         case 'o': /* make a specfile */
-            mode = SPECFILE;
+            if (!set_only_mode(SPECFILE, &only_mode))
+                return 1;
+            break;
+        case 'r': /* recursive */
+            input_add_dir(optarg);
+            input_count++;
             break;
         case 'v': /* version */
-            printf("semblance version " VERSION "\n");
+            fprintf(out, "semblance version " VERSION "\n");
             return 0;
         case 's': /* full contents */
             opts |= FULL_CONTENTS;
@@ -219,23 +578,217 @@ int main(int argc, char *argv[]){
                 return 1;
             }
             break;
+        case 0x81:
+            mode |= VERIFYSUM;
+            break;
+        case 0x82:
+            mode |= IMAGEHASH;
+            break;
+        case 0x83:
+            mode |= IMPORTHASH;
+            break;
+        case 0x84:
+            if (!set_only_mode(CLUSTER, &only_mode))
+                return 1;
+            break;
+        case 0x85:
+            mode |= EXTRACT;
+            extract_dir = optarg;
+            break;
+        case 0x86:
+            if (!set_only_mode(VERSIONINFO, &only_mode))
+                return 1;
+            break;
+        case 0x87:
+            unordered = 1;
+            break;
+        case 0x88:
+            /* Standard input is where the server reads requests from. */
+            if (request && !strcmp(optarg, "-")) {
+                fprintf(stderr, "--files-from=- can't be used in a server request.\n");
+                return 1;
+            }
+            input_add_list(optarg);
+            input_count++;
+            break;
+        case 0x89:
+        {
+            char *end;
+            unsigned long n = strtoul(optarg, &end, 10);
+            if (*end || n > 4096) {
+                fprintf(stderr, "Invalid number of files to prefetch `%s'.\n", optarg);
+                return 1;
+            }
+            prefetch_count = n;
+            break;
+        }
+        case 0x8a:
+            if (!set_only_mode(TRIAGE, &only_mode))
+                return 1;
+            break;
+        case 0x8b:
+            if (!parse_map_options(optarg)) {
+                fprintf(stderr, "Unrecognized --map option `%s'.\n", optarg);
+                return 1;
+            }
+            break;
+        case 0x8c:
+            if (!strcmp(optarg, "text"))
+                output_format = FORMAT_TEXT;
+            else if (!strcmp(optarg, "jsonl"))
+                output_format = FORMAT_JSONL;
+            else if (!strcmp(optarg, "binary"))
+                output_format = FORMAT_BINARY;
+            else {
+                fprintf(stderr, "Unrecognized output format `%s'.\n", optarg);
+                return 1;
+            }
+            break;
+        case 0x8d:
+            if (!index_open(optarg)) {
+                fprintf(stderr, "Cannot open %s: %s\n", optarg, strerror(errno));
+                return 1;
+            }
+            break;
+        case 0x8e:
+            dedup = 1;
+            break;
+        case 0x8f:
+            cache_dir = optarg;
+            break;
+        case 0x90:
+            server_mode = 1;
+            server_path = optarg;
+            break;
+        case 0x91:
+            if (!parse_size(optarg, &cache_memory)) {
+                fprintf(stderr, "Invalid cache size `%s'.\n", optarg);
+                return 1;
+            }
+            break;
+        case 0x92:
+            if (!where_add(&where_clauses, &where_count, optarg)) {
+                fprintf(stderr, "Unrecognized --where predicate `%s'.\n", optarg);
+                return 1;
+            }
+            break;
         default:
             fprintf(stderr, "Usage: dumpne [options] <file>\n");
             return 1;
         }
     }
 
+    /* Catch options which choose what to dump given after one of these. */
+    if (only_mode && !set_only_mode(only_mode, &only_mode))
+        return 1;
+
+    if (output_format != FORMAT_TEXT && (mode == SPECFILE || mode == CLUSTER
+            || mode == VERSIONINFO || mode == TRIAGE)) {
+        fprintf(stderr, "--format can't be used with --specfile, --cluster-imports, --version-info, or --triage.\n");
+        return 1;
+    }
+
+    /* These print something for every file, so every file has to be read. */
+    if (dedup && (mode == SPECFILE || mode == CLUSTER || mode == VERSIONINFO
+            || mode == TRIAGE || (mode & EXTRACT))) {
+        fprintf(stderr, "--dedup can't be used with --specfile, --cluster-imports, --version-info, --triage, or --extract-resources.\n");
+        return 1;
+    }
+
+    /* Checksums and hashes are never computed unless asked for. */
     if (mode == 0)
-        mode = ~0;
+        mode = ~(VERIFYSUM | IMAGEHASH | IMPORTHASH | EXTRACT);
+
+    /* When extracting, -a only selects which resources to extract. */
+    if (mode & EXTRACT)
+        mode &= ~DUMPRSRC;
 
-    if (optind == argc)
-        printf(help_message);
+    if ((mode & EXTRACT) && mkdir(extract_dir, 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s: %s\n", extract_dir, strerror(errno));
+        return 1;
+    }
 
-    while (optind < argc){
-        dump_file(argv[optind++]);
-        if (optind < argc)
-            printf("\n\n");
+    if (cache_dir && mkdir(cache_dir, 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s: %s\n", cache_dir, strerror(errno));
+        return 1;
     }
 
+    if (server_mode && !request) {
+        if (optind < argc || input_count) {
+            fprintf(stderr, "Files to dump are given in requests to the server.\n");
+            return 1;
+        }
+        if (prefetch_count) {
+            fprintf(stderr, "--prefetch can't be used with --server.\n");
+            return 1;
+        }
+        if (!cache_memory)
+            cache_memory = 256 << 20;
+        return -1;
+    }
+
+    if (optind == argc && !input_count)
+        fputs(help_message, out);
+
+    while (optind < argc)
+        input_add_file(argv[optind++]);
+
+    return -1;
+}
+
+static void dump_files(void)
+{
+    file_index = 0;
+    output_offset = record_stream_begin();
+
+    if (thread_count > 1 || index_enabled()) {
+        if (!thread_count)
+            thread_count = 1;
+        dump_files_parallel();
+    }
+    else {
+        char *file;
+
+        while ((file = prefetch_next())){
+            if (file_index && !summary_mode())
+                fputs("\n\n", out);
+            dump_file(file);
+            free(file);
+            file_index++;
+        }
+    }
+
+    if (mode == CLUSTER)
+        print_clusters();
+}
+
+int dump_request(int argc, char *argv[])
+{
+    int ret;
+
+    reset_options();
+    if ((ret = parse_options(argc, argv, 1)) >= 0)
+        return ret;
+    dump_files();
+    return 0;
+}
+
+int main(int argc, char *argv[]){
+    int ret;
+
+    program_name = argv[0];
+    out = stdout;
+
+    reset_options();
+    if ((ret = parse_options(argc, argv, 0)) >= 0)
+        return ret;
+
+    if (server_mode)
+        return serve(server_path);
+
+    if (prefetch_count)
+        prefetch_init(prefetch_count);
+
+    dump_files();
     return 0;
 }
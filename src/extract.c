@@ -0,0 +1,249 @@
+/*
+ * Extracting resources to files
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* for copy_file_range() */
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "semblance.h"
+#include "extract.h"
+
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+void extract_sanitize(char *dst, size_t size, const char *src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len && i < size - 1 && src[i]; i++)
+        dst[i] = (isalnum((byte)src[i]) || src[i] == '-' || src[i] == '.') ? src[i] : '_';
+    dst[i] = 0;
+}
+
+static int create_file(const char *type, const char *id, const char *ext, char *path, size_t size)
+{
+    const char *base = strrchr(file_name, '/');
+    unsigned n = 1;
+    int fd;
+
+    base = base ? base + 1 : file_name;
+    snprintf(path, size, "%s/%s_%s_%s%s", extract_dir, base, type, id, ext);
+    /* Different names can come out the same once they're sanitized, and
+     * input files in different directories can have the same name, so
+     * don't overwrite anything; add a number instead. */
+    while ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0666)) < 0 && errno == EEXIST && n < 10000)
+        snprintf(path, size, "%s/%s_%s_%s-%u%s", extract_dir, base, type, id, ++n, ext);
+    if (fd < 0)
+        fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+    return fd;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const byte *p = data;
+    ssize_t ret;
+
+    while (size)
+    {
+        if ((ret = write(fd, p, size)) < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+/* Copy part of the input file to the output file. Let the kernel do it if
+ * we can; otherwise write it out from the map. */
+static int copy_range(int fd, off_t offset, size_t size)
+{
+    ssize_t ret;
+
+#ifdef HAVE_COPY_FILE_RANGE
+    while (size)
+    {
+        loff_t in = offset;
+        if ((ret = copy_file_range(map_fd, &in, fd, NULL, size, 0)) <= 0)
+            break;
+        offset += ret;
+        size -= ret;
+    }
+#endif
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+    while (size)
+    {
+        if ((ret = sendfile(fd, map_fd, &offset, size)) <= 0)
+            break;
+        size -= ret;
+    }
+#endif
+    return write_all(fd, map + offset, size);
+}
+
+/* Clamp a range to the end of the file. */
+static dword clamp_size(off_t offset, dword size)
+{
+    if (offset >= map_size) {
+        warn("Resource at %#lx is past the end of the file.\n", offset);
+        return 0;
+    }
+    if (size > map_size - offset) {
+        warn("Resource at %#lx runs past the end of the file.\n", offset);
+        return map_size - offset;
+    }
+    return size;
+}
+
+static void finish_file(int fd, const char *path, int ret)
+{
+    if (ret < 0)
+        fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+    if (close(fd) < 0 && ret >= 0)
+        fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+}
+
+static void put_word(byte *p, word w)
+{
+    p[0] = w;
+    p[1] = w >> 8;
+}
+
+static void put_dword(byte *p, dword d)
+{
+    put_word(p, d);
+    put_word(p + 2, d >> 16);
+}
+
+void extract_raw(const char *type, const char *id, off_t offset, dword size)
+{
+    char path[1024];
+    int fd;
+
+    if ((fd = create_file(type, id, ".bin", path, sizeof(path))) < 0)
+        return;
+    finish_file(fd, path, copy_range(fd, offset, clamp_size(offset, size)));
+}
+
+/* A bitmap resource is a bitmap file without the file header. To write one
+ * we need to know where the bits start, i.e. how big the palette is. */
+void extract_bitmap(const char *type, const char *id, off_t offset, dword size)
+{
+    byte header[14];
+    dword header_size, colors = 0, bits;
+    word bitcount;
+    char path[1024];
+    int fd, ret;
+
+    size = clamp_size(offset, size);
+    if (size < 12 || (header_size = read_dword(offset)) > size) {
+        extract_raw(type, id, offset, size);
+        return;
+    }
+
+    if (header_size == 12) /* BITMAPCOREHEADER */
+    {
+        bitcount = read_word(offset + 10);
+        if (bitcount <= 8)
+            colors = 1 << bitcount;
+        bits = header_size + colors * 3;
+    }
+    else
+    {
+        if (header_size < 40) {
+            extract_raw(type, id, offset, size);
+            return;
+        }
+        bitcount = read_word(offset + 14);
+        colors = read_dword(offset + 32);
+        if (!colors && bitcount <= 8)
+            colors = 1 << bitcount;
+        bits = header_size + colors * 4;
+        if (read_dword(offset + 16) == 3 && header_size == 40) /* BI_BITFIELDS */
+            bits += 12;
+    }
+
+    if ((fd = create_file(type, id, ".bmp", path, sizeof(path))) < 0)
+        return;
+
+    header[0] = 'B';
+    header[1] = 'M';
+    put_dword(header + 2, sizeof(header) + size);
+    put_dword(header + 6, 0);
+    put_dword(header + 10, sizeof(header) + bits);
+    if (!(ret = write_all(fd, header, sizeof(header))))
+        ret = copy_range(fd, offset, size);
+    finish_file(fd, path, ret);
+}
+
+/* Write an icon or cursor file, consisting of a directory followed by each
+ * image. */
+void extract_icon(const char *type, const char *id, int cursor,
+        const struct extract_image *images, unsigned count)
+{
+    byte *header;
+    size_t header_size = 6 + count * 16;
+    dword offset = header_size, *sizes;
+    char path[1024];
+    unsigned i;
+    int fd, ret;
+
+    if ((fd = create_file(type, id, cursor ? ".cur" : ".ico", path, sizeof(path))) < 0)
+        return;
+
+    header = malloc(header_size);
+    sizes = malloc(count * sizeof(*sizes));
+    put_word(header, 0);
+    put_word(header + 2, cursor ? 2 : 1);
+    put_word(header + 4, count);
+    for (i = 0; i < count; i++)
+    {
+        byte *entry = header + 6 + i * 16;
+        dword size = sizes[i] = clamp_size(images[i].offset, images[i].size);
+
+        entry[0] = images[i].width;
+        entry[1] = images[i].height;
+        entry[2] = images[i].colors;
+        entry[3] = 0;
+        put_word(entry + 4, images[i].planes);
+        put_word(entry + 6, images[i].bitcount);
+        put_dword(entry + 8, size);
+        put_dword(entry + 12, offset);
+        offset += size;
+    }
+
+    ret = write_all(fd, header, header_size);
+    for (i = 0; i < count && !ret; i++)
+        ret = copy_range(fd, images[i].offset, sizes[i]);
+    finish_file(fd, path, ret);
+    free(sizes);
+    free(header);
+}
@@ -0,0 +1,27 @@
+#ifndef __EXTRACT_H
+#define __EXTRACT_H
+
+#include "semblance.h"
+
+/* An image in an icon or cursor file. */
+struct extract_image {
+    byte width;
+    byte height;
+    byte colors;
+    word planes;            /* for cursors, the hotspot x */
+    word bitcount;          /* for cursors, the hotspot y */
+    off_t offset;
+    dword size;
+};
+
+/* Make a string safe to use as part of a file name. */
+extern void extract_sanitize(char *dst, size_t size, const char *src, size_t len);
+
+/* Write a resource to a file in the extraction directory, named after the
+ * input file, the resource type and the resource ID. */
+extern void extract_raw(const char *type, const char *id, off_t offset, dword size);
+extern void extract_bitmap(const char *type, const char *id, off_t offset, dword size);
+extern void extract_icon(const char *type, const char *id, int cursor,
+        const struct extract_image *images, unsigned count);
+
+#endif /* __EXTRACT_H */
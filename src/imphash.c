@@ -0,0 +1,213 @@
+/*
+ * Fingerprinting and clustering modules by their imports
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "semblance.h"
+#include "imphash.h"
+#include "record.h"
+
+/* Imports are normalized so that trivial differences between linkers don't
+ * matter: everything is lowercase, the module's extension is dropped, and
+ * ordinal imports are written as "module.#123". The order of imports doesn't
+ * matter either, since the set is sorted before hashing. */
+void import_set_add(struct import_set *set, const char *module, const char *name, int ordinal)
+{
+    size_t module_len = strlen(module), len;
+    const char *ext = strrchr(module, '.');
+    char *entry, *p;
+
+    if (ext)
+        module_len = ext - module;
+
+    len = module_len + 1 + (name ? strlen(name) : 6) + 1;
+    entry = malloc(len);
+    if (name)
+        snprintf(entry, len, "%.*s.%s", (int)module_len, module, name);
+    else if (ordinal >= 0)
+        snprintf(entry, len, "%.*s.#%u", (int)module_len, module, ordinal);
+    else
+        snprintf(entry, len, "%.*s", (int)module_len, module);
+
+    for (p = entry; *p; p++)
+        *p = tolower(*p);
+
+    if (set->count == set->size)
+    {
+        set->size = set->size ? set->size * 2 : 64;
+        set->entries = realloc(set->entries, set->size * sizeof(*set->entries));
+    }
+    set->entries[set->count++] = entry;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+void import_set_hash(struct import_set *set, byte digest[SHA256_DIGEST_SIZE])
+{
+    struct sha256 ctx;
+    unsigned i;
+
+    /* entries is NULL if there are no imports, which qsort() mustn't be given. */
+    if (set->count)
+        qsort(set->entries, set->count, sizeof(*set->entries), compare_entries);
+
+    sha256_init(&ctx);
+    for (i = 0; i < set->count; i++)
+    {
+        if (i && !strcmp(set->entries[i], set->entries[i - 1]))
+            continue;
+        sha256_update(&ctx, set->entries[i], strlen(set->entries[i]) + 1);
+    }
+    sha256_final(&ctx, digest);
+
+    for (i = 0; i < set->count; i++)
+        free(set->entries[i]);
+    free(set->entries);
+    memset(set, 0, sizeof(*set));
+}
+
+/* For --cluster-imports we just collect the hashes of every file, and then
+ * group them when we're done. Files may be dumped in any order with -j, so
+ * they're kept in command-line order by their index. */
+
+struct hashed_file {
+    byte digest[SHA256_DIGEST_SIZE];
+    unsigned index;
+    char *name;
+};
+
+static struct hashed_file *hashed_files;
+static unsigned hashed_count, hashed_size;
+static pthread_mutex_t hashed_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void print_import_hash(const byte digest[SHA256_DIGEST_SIZE])
+{
+    int i;
+
+    if (mode == CLUSTER)
+    {
+        pthread_mutex_lock(&hashed_lock);
+        if (hashed_count == hashed_size)
+        {
+            hashed_size = hashed_size ? hashed_size * 2 : 256;
+            hashed_files = realloc(hashed_files, hashed_size * sizeof(*hashed_files));
+        }
+        memcpy(hashed_files[hashed_count].digest, digest, SHA256_DIGEST_SIZE);
+        hashed_files[hashed_count].index = file_index;
+        hashed_files[hashed_count].name = strdup(file_name);
+        hashed_count++;
+        pthread_mutex_unlock(&hashed_lock);
+        return;
+    }
+
+    if (output_format != FORMAT_TEXT)
+    {
+        record_begin("import_hash");
+        record_bytes("sha256", digest, SHA256_DIGEST_SIZE);
+        record_end();
+        return;
+    }
+
+    fprintf(out, "Import hash: ");
+    for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+        fprintf(out, "%02x", digest[i]);
+    putc('\n', out);
+}
+
+static int compare_hashed_files(const void *a, const void *b)
+{
+    const struct hashed_file *f1 = a, *f2 = b;
+    int ret;
+
+    if ((ret = memcmp(f1->digest, f2->digest, SHA256_DIGEST_SIZE)))
+        return ret;
+    return (f1->index > f2->index) - (f1->index < f2->index);
+}
+
+struct cluster {
+    unsigned start;
+    unsigned count;
+};
+
+/* Largest clusters first; otherwise keep the order of the hashes. */
+static int compare_clusters(const void *a, const void *b)
+{
+    const struct cluster *c1 = a, *c2 = b;
+
+    if (c1->count != c2->count)
+        return (c1->count < c2->count) - (c1->count > c2->count);
+    return (c1->start > c2->start) - (c1->start < c2->start);
+}
+
+void print_clusters(void)
+{
+    struct cluster *clusters;
+    unsigned i, j, count = 0;
+
+    if (!hashed_count)
+        return;
+
+    qsort(hashed_files, hashed_count, sizeof(*hashed_files), compare_hashed_files);
+
+    clusters = malloc(hashed_count * sizeof(*clusters));
+    for (i = 0; i < hashed_count; i++)
+    {
+        if (i && !memcmp(hashed_files[i].digest, hashed_files[i - 1].digest, SHA256_DIGEST_SIZE))
+        {
+            clusters[count - 1].count++;
+            continue;
+        }
+        clusters[count].start = i;
+        clusters[count].count = 1;
+        count++;
+    }
+
+    qsort(clusters, count, sizeof(*clusters), compare_clusters);
+
+    for (i = 0; i < count; i++)
+    {
+        const struct hashed_file *first = &hashed_files[clusters[i].start];
+
+        fprintf(out, "Cluster %u (%u file%s, import hash ", i + 1, clusters[i].count,
+                clusters[i].count == 1 ? "" : "s");
+        for (j = 0; j < SHA256_DIGEST_SIZE; j++)
+            fprintf(out, "%02x", first->digest[j]);
+        fprintf(out, "):\n");
+
+        for (j = 0; j < clusters[i].count; j++)
+        {
+            fprintf(out, "\t%s\n", first[j].name);
+            free(first[j].name);
+        }
+    }
+
+    free(clusters);
+    free(hashed_files);
+    hashed_files = NULL;
+    hashed_count = hashed_size = 0;
+}
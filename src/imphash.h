@@ -0,0 +1,23 @@
+#ifndef __IMPHASH_H
+#define __IMPHASH_H
+
+#include "semblance.h"
+#include "sha256.h"
+
+/* An unordered set of imported functions, used to fingerprint a module. */
+struct import_set {
+    char **entries;
+    unsigned count;
+    unsigned size;
+};
+
+/* Add an import. If name is NULL, the import is by ordinal; if ordinal is also
+ * negative, the import is of the module as a whole. */
+extern void import_set_add(struct import_set *set, const char *module, const char *name, int ordinal);
+/* Hash and free the set. */
+extern void import_set_hash(struct import_set *set, byte digest[SHA256_DIGEST_SIZE]);
+
+extern void print_import_hash(const byte digest[SHA256_DIGEST_SIZE]);
+extern void print_clusters(void);
+
+#endif /* __IMPHASH_H */
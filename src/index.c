@@ -0,0 +1,150 @@
+/*
+ * Writing an index of the output (--index)
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "semblance.h"
+#include "index.h"
+
+enum index_kind
+{
+    INDEX_SECTION,
+    INDEX_FUNCTION,
+    INDEX_ADDRESS,
+};
+
+struct index_entry
+{
+    enum index_kind kind;
+    word segment;
+    qword address;
+    long offset;
+    const char *name;
+};
+
+static const char *const kind_names[] =
+{
+    [INDEX_SECTION] = "section",
+    [INDEX_FUNCTION] = "function",
+    [INDEX_ADDRESS] = "address",
+};
+
+__thread struct listing_index *listing_index;
+
+static FILE *index_file;
+
+int index_open(const char *path)
+{
+    return !!(index_file = fopen(path, "w"));
+}
+
+int index_enabled(void)
+{
+    return !!index_file;
+}
+
+static struct index_entry *add_entry(enum index_kind kind, word segment, qword address, long offset)
+{
+    struct listing_index *index = listing_index;
+    struct index_entry *entry;
+
+    if (index->count == index->size)
+    {
+        index->size = index->size ? index->size * 2 : 256;
+        index->entries = realloc(index->entries, index->size * sizeof(*index->entries));
+    }
+    entry = &index->entries[index->count++];
+    entry->kind = kind;
+    entry->segment = segment;
+    entry->address = address;
+    entry->offset = offset;
+    entry->name = NULL;
+    index->last_offset = offset;
+    return entry;
+}
+
+void index_section(const char *name, size_t len, word segment, qword address)
+{
+    if (!listing_index)
+        return;
+    add_entry(INDEX_SECTION, segment, address, ftell(out))->name =
+            name ? arena_strndup(&listing_index->names, name, len) : NULL;
+}
+
+void index_function(const char *name, word segment, qword address)
+{
+    if (!listing_index)
+        return;
+    add_entry(INDEX_FUNCTION, segment, address, ftell(out))->name =
+            name ? arena_strndup(&listing_index->names, name, strlen(name)) : NULL;
+}
+
+void index_address(word segment, qword address)
+{
+    long offset;
+
+    if (!listing_index)
+        return;
+    /* Sections and functions count too, so a function shorter than the
+     * interval gets no address entries at all. */
+    offset = ftell(out);
+    if (offset - listing_index->last_offset >= INDEX_INTERVAL || !listing_index->count)
+        add_entry(INDEX_ADDRESS, segment, address, offset);
+}
+
+/* Names come from the file, so keep them from breaking up the line. */
+static void write_name(const char *name)
+{
+    for (; *name; name++)
+        putc((*name == '\n' || *name == '\r') ? '?' : *name, index_file);
+}
+
+void index_write(struct listing_index *index, const char *file, off_t base)
+{
+    size_t i;
+
+    fprintf(index_file, "file %ld ", base);
+    write_name(file);
+    putc('\n', index_file);
+
+    for (i = 0; i < index->count; i++)
+    {
+        const struct index_entry *entry = &index->entries[i];
+
+        fprintf(index_file, "%s %ld ", kind_names[entry->kind], base + entry->offset);
+        if (entry->segment)
+            fprintf(index_file, "%d:%04lx", entry->segment, entry->address);
+        else
+            fprintf(index_file, "%lx", entry->address);
+        if (entry->name)
+        {
+            putc(' ', index_file);
+            write_name(entry->name);
+        }
+        putc('\n', index_file);
+    }
+
+    free(index->entries);
+    arena_free(&index->names);
+    memset(index, 0, sizeof(*index));
+}
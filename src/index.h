@@ -0,0 +1,53 @@
+#ifndef __INDEX_H
+#define __INDEX_H
+
+#include "semblance.h"
+
+/* With --index, we write a sidecar file alongside the output, so that viewers
+ * can seek straight to a file, section, function, or address in a listing
+ * instead of reading it from the start. It has one entry on each line:
+ *
+ *     file OFFSET NAME
+ *     section OFFSET ADDRESS [NAME]
+ *     function OFFSET ADDRESS [NAME]
+ *     address OFFSET ADDRESS
+ *
+ * OFFSET is the byte offset in the output, in decimal. ADDRESS is printed as
+ * in the listing: hexadecimal, or SEGMENT:OFFSET for NE files. Entries for a
+ * file are in the same order as its output. Not every instruction gets an
+ * address entry, only one every INDEX_INTERVAL bytes or so, so a viewer looks
+ * up the last entry before the address it wants and reads forward from
+ * there. */
+
+#define INDEX_INTERVAL 4096
+
+struct index_entry;
+
+/* The entries for one file. Offsets are relative to the start of that file's
+ * output until they are written. */
+struct listing_index
+{
+    struct index_entry *entries;
+    size_t count, size;
+    long last_offset;
+    struct arena names;
+};
+
+/* The index for the file being dumped, or NULL if we aren't writing one. */
+extern __thread struct listing_index *listing_index;
+
+/* Open the index file. Returns 0 and sets errno on failure. */
+extern int index_open(const char *path);
+extern int index_enabled(void);
+
+/* Note the current position in "out". The segment is 0 except for NE files,
+ * and names may be NULL. */
+extern void index_section(const char *name, size_t len, word segment, qword address);
+extern void index_function(const char *name, word segment, qword address);
+extern void index_address(word segment, qword address);
+
+/* Write the entries for a file whose output starts at "base", and free
+ * them. */
+extern void index_write(struct listing_index *index, const char *file, off_t base);
+
+#endif /* __INDEX_H */
@@ -0,0 +1,247 @@
+/*
+ * Finding the files to dump
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "semblance.h"
+#include "input.h"
+
+/* Files are given on the command line, found by walking directories, or read
+ * from a list. Names are produced one at a time, so that a whole archive can
+ * be dumped without first collecting every name in it. */
+
+enum source_type {
+    SOURCE_FILE,
+    SOURCE_DIR,
+    SOURCE_LIST,
+};
+
+struct source {
+    enum source_type type;
+    char *name;
+};
+
+static struct source *sources;
+static unsigned source_count, source_next;
+
+/* The directories being walked; the last one is the innermost. */
+struct dir_level {
+    char *path;
+    struct dirent **entries;
+    int count;
+    int index;
+};
+
+static struct dir_level *levels;
+static unsigned level_count, level_size;
+
+/* The list being read, if any. */
+static FILE *list;
+static char *list_line;
+static size_t list_line_size;
+
+static void add_source(enum source_type type, const char *name)
+{
+    sources = realloc(sources, (source_count + 1) * sizeof(*sources));
+    sources[source_count].type = type;
+    sources[source_count].name = strdup(name);
+    source_count++;
+}
+
+void input_add_file(const char *name)
+{
+    add_source(SOURCE_FILE, name);
+}
+
+void input_add_dir(const char *name)
+{
+    add_source(SOURCE_DIR, name);
+}
+
+void input_add_list(const char *name)
+{
+    add_source(SOURCE_LIST, name);
+}
+
+static int filter_dots(const struct dirent *entry)
+{
+    return strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..");
+}
+
+/* Takes ownership of path. Entries are sorted, so that the output doesn't
+ * depend on the filesystem. */
+static void push_dir(char *path)
+{
+    struct dir_level *level;
+    struct dirent **entries;
+    int count;
+
+    if ((count = scandir(path, &entries, filter_dots, alphasort)) < 0) {
+        fprintf(stderr, "Cannot read directory %s: %s\n", path, strerror(errno));
+        free(path);
+        return;
+    }
+
+    if (level_count == level_size)
+    {
+        level_size = level_size ? level_size * 2 : 16;
+        levels = realloc(levels, level_size * sizeof(*levels));
+    }
+    level = &levels[level_count++];
+    level->path = path;
+    level->entries = entries;
+    level->count = count;
+    level->index = 0;
+}
+
+/* Symbolic links are skipped, so that we never loop or dump a file twice. */
+static char *next_in_dir(void)
+{
+    struct dir_level *level;
+    struct stat st;
+    size_t len;
+    char *path;
+
+    while (level_count)
+    {
+        level = &levels[level_count - 1];
+        if (level->index == level->count) {
+            free(level->entries);
+            free(level->path);
+            level_count--;
+            continue;
+        }
+
+        len = strlen(level->path);
+        path = malloc(len + 1 + strlen(level->entries[level->index]->d_name) + 1);
+        strcpy(path, level->path);
+        if (len && path[len - 1] != '/')
+            path[len++] = '/';
+        strcpy(path + len, level->entries[level->index]->d_name);
+        free(level->entries[level->index++]);
+
+        if (lstat(path, &st) < 0) {
+            fprintf(stderr, "Cannot stat %s: %s\n", path, strerror(errno));
+            free(path);
+        } else if (S_ISDIR(st.st_mode)) {
+            push_dir(path);
+        } else if (S_ISREG(st.st_mode)) {
+            return path;
+        } else {
+            free(path);
+        }
+    }
+
+    return NULL;
+}
+
+/* Lists are separated by nulls, as from `find -print0'. */
+static char *next_in_list(void)
+{
+    while (getdelim(&list_line, &list_line_size, 0, list) >= 0)
+    {
+        if (*list_line)
+            return strdup(list_line);
+    }
+
+    if (ferror(list))
+        fprintf(stderr, "Cannot read file list: %s\n", strerror(errno));
+    if (list != stdin)
+        fclose(list);
+    list = NULL;
+    return NULL;
+}
+
+void input_reset(void)
+{
+    unsigned i;
+    int j;
+
+    for (i = 0; i < source_count; i++)
+        free(sources[i].name);
+    free(sources);
+    sources = NULL;
+    source_count = source_next = 0;
+
+    for (i = 0; i < level_count; i++) {
+        for (j = levels[i].index; j < levels[i].count; j++)
+            free(levels[i].entries[j]);
+        free(levels[i].entries);
+        free(levels[i].path);
+    }
+    free(levels);
+    levels = NULL;
+    level_count = level_size = 0;
+
+    if (list && list != stdin)
+        fclose(list);
+    list = NULL;
+    free(list_line);
+    list_line = NULL;
+    list_line_size = 0;
+}
+
+char *input_next(void)
+{
+    const struct source *source;
+    char *file;
+
+    for (;;)
+    {
+        if (level_count) {
+            if ((file = next_in_dir()))
+                return file;
+            continue;
+        }
+
+        if (list) {
+            if ((file = next_in_list()))
+                return file;
+            continue;
+        }
+
+        if (source_next == source_count) {
+            input_reset();
+            return NULL;
+        }
+
+        source = &sources[source_next++];
+        switch (source->type)
+        {
+        case SOURCE_FILE:
+            return strdup(source->name);
+        case SOURCE_DIR:
+            push_dir(strdup(source->name));
+            break;
+        case SOURCE_LIST:
+            if (!strcmp(source->name, "-"))
+                list = stdin;
+            else if (!(list = fopen(source->name, "r")))
+                fprintf(stderr, "Cannot open %s: %s\n", source->name, strerror(errno));
+            break;
+        }
+    }
+}
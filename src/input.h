@@ -0,0 +1,16 @@
+#ifndef __INPUT_H
+#define __INPUT_H
+
+/* Sources of files to dump, in the order they should be dumped. */
+extern void input_add_file(const char *name);
+extern void input_add_dir(const char *name);
+extern void input_add_list(const char *name);
+
+/* Get the name of the next file to dump, which the caller should free, or
+ * NULL if there are no more. */
+extern char *input_next(void);
+
+/* Forget any sources that haven't been dumped yet. */
+extern void input_reset(void);
+
+#endif /* __INPUT_H */
@@ -0,0 +1,254 @@
+/*
+ * The libsemblance library interface
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "semblance.h"
+#include "demangle.h"
+#include "libsemblance.h"
+#include "record.h"
+#include "where.h"
+#include "x86_instr.h"
+
+STATIC_ASSERT(SEMBLANCE_HEADERS == DUMPHEADER && SEMBLANCE_RESOURCES == DUMPRSRC
+        && SEMBLANCE_EXPORTS == DUMPEXPORT && SEMBLANCE_IMPORTS == DUMPIMPORT
+        && SEMBLANCE_DISASSEMBLE == DISASSEMBLE && SEMBLANCE_CHECKSUM == VERIFYSUM
+        && SEMBLANCE_IMAGE_HASH == IMAGEHASH && SEMBLANCE_IMPORT_HASH == IMPORTHASH);
+STATIC_ASSERT(SEMBLANCE_DISASSEMBLE_ALL == DISASSEMBLE_ALL && SEMBLANCE_DEMANGLE == DEMANGLE
+        && SEMBLANCE_NO_SHOW_RAW_INSN == NO_SHOW_RAW_INSN
+        && SEMBLANCE_NO_SHOW_ADDRESSES == NO_SHOW_ADDRESSES
+        && SEMBLANCE_COMPILABLE == COMPILABLE && SEMBLANCE_FULL_CONTENTS == FULL_CONTENTS);
+STATIC_ASSERT((int)SEMBLANCE_GAS == GAS && (int)SEMBLANCE_NASM == NASM && (int)SEMBLANCE_MASM == MASM);
+STATIC_ASSERT((int)SEMBLANCE_TEXT == FORMAT_TEXT && (int)SEMBLANCE_JSONL == FORMAT_JSONL
+        && (int)SEMBLANCE_BINARY == FORMAT_BINARY);
+
+struct semblance
+{
+    byte *map;
+    off_t size;
+    char *name;
+    int corrupt;
+
+    /* The options to set while dumping this file. The resource filters are
+     * ours. */
+    struct options options;
+};
+
+static struct semblance *create_context(byte *region, off_t size, const char *name)
+{
+    struct semblance *sb;
+
+    if (region == MAP_FAILED)
+        return NULL;
+
+    if (!(sb = calloc(1, sizeof(*sb)))) {
+        unmap_file(region, size);
+        return NULL;
+    }
+    sb->map = region;
+    sb->size = size;
+    sb->name = strdup(name ? name : "");
+    sb->options.asm_syntax = NASM;
+    sb->options.output_format = FORMAT_TEXT;
+    sb->options.pe_rel_addr = -1;
+    return sb;
+}
+
+struct semblance *semblance_open_fd(int fd, const char *name)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) < 0)
+        return NULL;
+
+    /* Too small to have a header, and mapping an empty file fails. */
+    if (st.st_size < 0x40) {
+        errno = ENOEXEC;
+        return NULL;
+    }
+
+    return create_context(map_file(fd, st.st_size), st.st_size, name);
+}
+
+struct semblance *semblance_open_buffer(const void *data, size_t size, const char *name)
+{
+    if (size < 0x40) {
+        errno = ENOEXEC;
+        return NULL;
+    }
+
+    return create_context(map_buffer(data, size), size, name);
+}
+
+void semblance_close(struct semblance *sb)
+{
+    unsigned i;
+
+    if (!sb)
+        return;
+
+    for (i = 0; i < sb->options.resource_filters_count; i++)
+        free(sb->options.resource_filters[i]);
+    free(sb->options.resource_filters);
+    where_free(sb->options.where_clauses, sb->options.where_count);
+    unmap_file(sb->map, sb->size);
+    free(sb->name);
+    free(sb);
+}
+
+void semblance_set_options(struct semblance *sb, unsigned options)
+{
+    sb->options.opts = options;
+}
+
+void semblance_set_syntax(struct semblance *sb, enum semblance_syntax syntax)
+{
+    sb->options.asm_syntax = (enum asm_syntax)syntax;
+}
+
+void semblance_set_format(struct semblance *sb, enum semblance_format format)
+{
+    sb->options.output_format = (enum output_format)format;
+}
+
+void semblance_set_rel_addr(struct semblance *sb, int rel_addr)
+{
+    sb->options.pe_rel_addr = rel_addr;
+}
+
+void semblance_add_resource_filter(struct semblance *sb, const char *filter)
+{
+    struct options *options = &sb->options;
+
+    options->resource_filters = realloc(options->resource_filters,
+            (options->resource_filters_count + 1) * sizeof(*options->resource_filters));
+    options->resource_filters[options->resource_filters_count++] = strdup(filter);
+}
+
+int semblance_add_where(struct semblance *sb, const char *predicate)
+{
+    if (!where_add(&sb->options.where_clauses, &sb->options.where_count, predicate)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int semblance_dump(struct semblance *sb, unsigned what, char **data, size_t *size)
+{
+    int ret;
+
+    if (!(out = open_memstream(data, size)))
+        return -1;
+
+    options_restore(&sb->options);
+    /* Extracting resources and the one-line modes are left to `dump'. */
+    mode = what ? what : ~(VERIFYSUM | IMAGEHASH | IMPORTHASH | EXTRACT);
+    mode &= ~(SPECFILE | CLUSTER | EXTRACT | VERSIONINFO | TRIAGE);
+
+    map = sb->map;
+    map_size = sb->size;
+    map_fd = -1;
+    map_error = 0;
+    file_name = sb->name;
+    file_index = 0;
+
+    record_stream_begin();
+    record_file_begin();
+    ret = dump_map();
+    record_thread_end();
+    demangle_thread_end();
+
+    sb->corrupt = map_error;
+    map = NULL;
+    map_size = 0;
+    file_name = NULL;
+
+    fclose(out);
+    out = NULL;
+
+    if (!ret) {
+        free(*data);
+        *data = NULL;
+        *size = 0;
+        errno = ENOEXEC;
+        return -1;
+    }
+    return 0;
+}
+
+int semblance_corrupt(const struct semblance *sb)
+{
+    return sb->corrupt;
+}
+
+int semblance_format_instr(const struct semblance *sb, const void *code, size_t len,
+        uint64_t address, int bits, char *buf, size_t size)
+{
+    struct instr instr = {0};
+    byte buffer[MAX_INSTR];
+    char ip_string[17];
+    char *text;
+    size_t text_size;
+    int instr_len;
+
+    memset(buffer, 0, sizeof(buffer));
+    memcpy(buffer, code, min(len, sizeof(buffer)));
+
+    /* The decoder works with 32-bit addresses; relative jumps are fixed up
+     * afterwards, as for PE files. */
+    instr_len = get_instr(address, buffer, &instr, bits);
+    if ((size_t)instr_len > len)
+        return 0;
+    if (instr.op.arg0 == REL8 || instr.op.arg0 == REL)
+        instr.args[0].value += address - (dword)address;
+
+    if (sb) {
+        opts = sb->options.opts;
+        asm_syntax = sb->options.asm_syntax;
+    } else {
+        opts = 0;
+        asm_syntax = NASM;
+    }
+    output_format = FORMAT_TEXT;
+
+    if (!(out = open_memstream(&text, &text_size)))
+        return 0;
+    sprintf(ip_string, "%8lx", address);
+    print_instr(ip_string, 0, address, buffer, instr_len, 0, &instr, NULL, bits);
+    fclose(out);
+    out = NULL;
+
+    if (text_size && text[text_size - 1] == '\n')
+        text[--text_size] = 0;
+    if (size) {
+        size_t copy = min(text_size, size - 1);
+        memcpy(buf, text, copy);
+        buf[copy] = 0;
+    }
+    free(text);
+    return instr_len;
+}
@@ -0,0 +1,88 @@
+#ifndef __LIBSEMBLANCE_H
+#define __LIBSEMBLANCE_H
+
+/* Dumping MZ, NE, and PE files from another program.
+ *
+ * A struct semblance holds one file, and the options to dump it with. Nothing
+ * is shared between contexts, so different contexts can be used on different
+ * threads at once; a single context must only be used by one thread at a time.
+ *
+ * What's dumped is returned in a buffer, in the same form `dump' prints it:
+ * a listing, JSON records, or the binary records which can be read with the
+ * functions in record_reader.h. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct semblance;
+
+/* What to dump, for semblance_dump(). Zero dumps everything but the checksum
+ * and hashes, like `dump' with no options. */
+#define SEMBLANCE_HEADERS       0x01
+#define SEMBLANCE_RESOURCES     0x02
+#define SEMBLANCE_EXPORTS       0x04
+#define SEMBLANCE_IMPORTS       0x08
+#define SEMBLANCE_DISASSEMBLE   0x10
+#define SEMBLANCE_CHECKSUM      0x20
+#define SEMBLANCE_IMAGE_HASH    0x40
+#define SEMBLANCE_IMPORT_HASH   0x100
+
+/* Options, for semblance_set_options(). */
+#define SEMBLANCE_DISASSEMBLE_ALL   0x01
+#define SEMBLANCE_DEMANGLE          0x02
+#define SEMBLANCE_NO_SHOW_RAW_INSN  0x04
+#define SEMBLANCE_NO_SHOW_ADDRESSES 0x08
+#define SEMBLANCE_COMPILABLE        0x10
+#define SEMBLANCE_FULL_CONTENTS     0x20
+
+enum semblance_syntax
+{
+    SEMBLANCE_GAS,
+    SEMBLANCE_NASM,
+    SEMBLANCE_MASM,
+};
+
+enum semblance_format
+{
+    SEMBLANCE_TEXT,
+    SEMBLANCE_JSONL,
+    SEMBLANCE_BINARY,
+};
+
+/* Open a file from a descriptor, which isn't used after this returns, or from
+ * a copy of a buffer. The name is used in messages and records. These return
+ * NULL and set errno on failure; ENOEXEC means the file is too small to be
+ * one we know. */
+extern struct semblance *semblance_open_fd(int fd, const char *name);
+extern struct semblance *semblance_open_buffer(const void *data, size_t size, const char *name);
+extern void semblance_close(struct semblance *sb);
+
+extern void semblance_set_options(struct semblance *sb, unsigned options);
+extern void semblance_set_syntax(struct semblance *sb, enum semblance_syntax syntax);
+extern void semblance_set_format(struct semblance *sb, enum semblance_format format);
+/* Print PE addresses relative to the image base (1) or not (0), or decide
+ * from the file (-1, the default). */
+extern void semblance_set_rel_addr(struct semblance *sb, int rel_addr);
+/* Only dump resources matching one of these, as for `dump -a'. */
+extern void semblance_add_resource_filter(struct semblance *sb, const char *filter);
+/* Only print instructions matching this, and any other predicates given, as
+ * for `dump --where'. Returns 0, or -1 and sets errno to EINVAL if it's not a
+ * predicate we know. */
+extern int semblance_add_where(struct semblance *sb, const char *predicate);
+
+/* Dump the file. The output is returned in *data, which is to be freed by
+ * the caller, and its length in *size. Returns 0 on success, or -1 and sets
+ * errno: ENOEXEC if the file isn't a format we know. */
+extern int semblance_dump(struct semblance *sb, unsigned what, char **data, size_t *size);
+/* Whether the last dump found the file to be truncated or corrupt. */
+extern int semblance_corrupt(const struct semblance *sb);
+
+/* Decode one instruction, of the given bits (16, 32, or 64), from up to len
+ * bytes of code at address, and print it into buf with the context's syntax
+ * and options. sb may be NULL to use the defaults. The text is truncated to
+ * fit in size bytes, like snprintf(). Returns the length of the instruction,
+ * or 0 if it's longer than len. */
+extern int semblance_format_instr(const struct semblance *sb, const void *code, size_t len,
+        uint64_t address, int bits, char *buf, size_t size);
+
+#endif /* __LIBSEMBLANCE_H */
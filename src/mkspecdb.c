@@ -0,0 +1,168 @@
+/*
+ * Compile specfiles into a single database
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "semblance.h"
+#include "specdb.h"
+
+struct module {
+    char *name;
+    char *data;
+    const char **names;
+    unsigned count;
+};
+
+static struct module *modules;
+static unsigned module_count;
+
+static char *read_file(const char *filename)
+{
+    FILE *f;
+    char *data;
+    long size;
+
+    if (!(f = fopen(filename, "rb"))) {
+        perror(filename);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(size + 1);
+    if (fread(data, 1, size, f) != size) {
+        perror(filename);
+        exit(1);
+    }
+    data[size] = 0;
+    fclose(f);
+    return data;
+}
+
+static int compare_modules(const void *a, const void *b)
+{
+    return strcmp(((const struct module *)a)->name, ((const struct module *)b)->name);
+}
+
+/* Everything is written little-endian, regardless of the host. */
+static void put_dword(FILE *f, dword d)
+{
+    putc(d, f);
+    putc(d >> 8, f);
+    putc(d >> 16, f);
+    putc(d >> 24, f);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output;
+    dword offset, string_offset;
+    unsigned i, j;
+    FILE *f;
+
+    if (argc < 3 || strcmp(argv[1], "-o")) {
+        fprintf(stderr, "Usage: %s -o <output> <specfile>...\n", argv[0]);
+        return 1;
+    }
+    output = argv[2];
+
+    modules = calloc(argc - 3, sizeof(*modules));
+    for (i = 3; i < argc; i++)
+    {
+        struct module *module = &modules[module_count++];
+        const char *base = strrchr(argv[i], '/');
+        char *ext;
+
+        module->name = strdup(base ? base + 1 : argv[i]);
+        if ((ext = strrchr(module->name, '.')))
+            *ext = 0;
+        module->data = read_file(argv[i]);
+        module->names = parse_specfile(module->data, argv[i], &module->count);
+    }
+
+    qsort(modules, module_count, sizeof(*modules), compare_modules);
+
+    for (i = 1; i < module_count; i++)
+    {
+        if (!strcmp(modules[i].name, modules[i - 1].name)) {
+            fprintf(stderr, "Module %s is given more than once.\n", modules[i].name);
+            return 1;
+        }
+    }
+
+    if (!(f = fopen(output, "wb"))) {
+        perror(output);
+        return 1;
+    }
+
+    put_dword(f, SPECDB_MAGIC);
+    put_dword(f, SPECDB_VERSION);
+    put_dword(f, module_count);
+
+    /* The ordinal arrays follow the module table, and the strings follow
+     * those. Module names come first in the string pool. */
+    offset = sizeof(struct specdb_header) + module_count * sizeof(struct specdb_module);
+    string_offset = offset;
+    for (i = 0; i < module_count; i++)
+        string_offset += modules[i].count * sizeof(dword);
+
+    for (i = 0; i < module_count; i++)
+    {
+        put_dword(f, string_offset);
+        put_dword(f, modules[i].count);
+        put_dword(f, offset);
+        string_offset += strlen(modules[i].name) + 1;
+        offset += modules[i].count * sizeof(dword);
+    }
+
+    for (i = 0; i < module_count; i++)
+    {
+        for (j = 0; j < modules[i].count; j++)
+        {
+            if (modules[i].names[j]) {
+                put_dword(f, string_offset);
+                string_offset += strlen(modules[i].names[j]) + 1;
+            } else
+                put_dword(f, 0);
+        }
+    }
+
+    for (i = 0; i < module_count; i++)
+        fwrite(modules[i].name, 1, strlen(modules[i].name) + 1, f);
+    for (i = 0; i < module_count; i++)
+    {
+        for (j = 0; j < modules[i].count; j++)
+        {
+            if (modules[i].names[j])
+                fwrite(modules[i].names[j], 1, strlen(modules[i].names[j]) + 1, f);
+        }
+    }
+
+    if (fclose(f)) {
+        perror(output);
+        return 1;
+    }
+
+    return 0;
+}
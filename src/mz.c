@@ -24,18 +24,34 @@
 #include <string.h>
 
 #include "semblance.h"
+#include "cache.h"
+#include "imphash.h"
+#include "index.h"
+#include "record.h"
+#include "where.h"
 #include "x86_instr.h"
 #include "mz.h"
 
 #pragma pack(1)
 
 static void print_header(const struct header_mz *header) {
-    putchar('\n');
-    printf("Minimum extra allocation: %d bytes\n", header->e_minalloc * 16); /* 0a */
-    printf("Maximum extra allocation: %d bytes\n", header->e_maxalloc * 16); /* 0c */
-    printf("Initial stack location: %#x\n", realaddr(header->e_ss, header->e_sp)); /* 0e */
-    printf("Program entry point: %#x\n", realaddr(header->e_cs, header->e_ip)); /* 14 */
-    printf("Overlay number: %d\n", header->e_ovno); /* 1a */
+    if (output_format != FORMAT_TEXT) {
+        record_begin("header");
+        record_uint("min_alloc", header->e_minalloc * 16);
+        record_uint("max_alloc", header->e_maxalloc * 16);
+        record_address("stack", realaddr(header->e_ss, header->e_sp));
+        record_address("entry_point", realaddr(header->e_cs, header->e_ip));
+        record_uint("overlay", header->e_ovno);
+        record_end();
+        return;
+    }
+
+    putc('\n', out);
+    fprintf(out, "Minimum extra allocation: %d bytes\n", header->e_minalloc * 16); /* 0a */
+    fprintf(out, "Maximum extra allocation: %d bytes\n", header->e_maxalloc * 16); /* 0c */
+    fprintf(out, "Initial stack location: %#x\n", realaddr(header->e_ss, header->e_sp)); /* 0e */
+    fprintf(out, "Program entry point: %#x\n", realaddr(header->e_cs, header->e_ip)); /* 14 */
+    fprintf(out, "Overlay number: %d\n", header->e_ovno); /* 1a */
 }
 
 #ifdef USE_WARN
@@ -48,15 +64,22 @@ static void print_header(const struct header_mz *header) {
 
 static int print_mz_instr(dword ip, const byte *p, const byte *flags) {
     struct instr instr = {0};
+    struct where_refs refs = {0};
     unsigned len;
 
     char ip_string[7];
 
     len = get_instr(ip, p, &instr, 16);
 
+    if (where_enabled()) {
+        where_add_operands(&refs, &instr, 0, ip + len);
+        if (!where_match(&instr, &refs))
+            return len;
+    }
+
     sprintf(ip_string, "%05x", ip);
 
-    print_instr(ip_string, p, len, flags[ip], &instr, NULL, 16);
+    print_instr(ip_string, 0, ip, p, len, flags[ip], &instr, NULL, 16);
 
     return len;
 }
@@ -65,8 +88,17 @@ static void print_code(struct mz *mz) {
     dword ip = 0;
     byte buffer[MAX_INSTR];
 
-    putchar('\n');
-    printf("Code (start = 0x%x, length = 0x%x):\n", mz->start, mz->length);
+    if (output_format != FORMAT_TEXT) {
+        index_section(NULL, 0, 0, 0);
+        record_begin("code");
+        record_uint("offset", mz->start);
+        record_uint("length", mz->length);
+        record_end();
+    } else {
+        putc('\n', out);
+        index_section(NULL, 0, 0, 0);
+        fprintf(out, "Code (start = 0x%x, length = 0x%x):\n", mz->start, mz->length);
+    }
 
     while (ip < mz->length) {
         /* find a valid instruction */
@@ -74,12 +106,14 @@ static void print_code(struct mz *mz) {
             if (opts & DISASSEMBLE_ALL) {
                 /* still skip zeroes */
                 if (read_byte(mz->start + ip) == 0) {
-                    printf("      ...\n");
+                    if (output_format == FORMAT_TEXT && !where_enabled())
+                        fprintf(out, "      ...\n");
                     ip++;
-                    while (read_byte(mz->start + ip) == 0) ip++;
+                    while (ip < mz->length && read_byte(mz->start + ip) == 0) ip++;
                 }
             } else {
-                printf("     ...\n");
+                if (output_format == FORMAT_TEXT && !where_enabled())
+                    fprintf(out, "     ...\n");
                 while ((ip < mz->length) && !(mz->flags[ip] & INSTR_VALID)) ip++;
             }
         }
@@ -94,8 +128,16 @@ static void print_code(struct mz *mz) {
         memcpy(buffer, read_data(mz->start + ip), min(sizeof(buffer), mz->length - ip));
 
         if (mz->flags[ip] & INSTR_FUNC) {
-            printf("\n");
-            printf("%05x <no name>:\n", ip);
+            if (output_format != FORMAT_TEXT) {
+                index_function(NULL, 0, ip);
+                record_begin("function");
+                record_address("address", ip);
+                record_end();
+            } else {
+                fprintf(out, "\n");
+                index_function(NULL, 0, ip);
+                fprintf(out, "%05x <no name>:\n", ip);
+            }
         }
 
         ip += print_mz_instr(ip, buffer, mz->flags);
@@ -108,7 +150,7 @@ static void scan_segment(dword ip, struct mz *mz) {
     int instr_length;
     int i;
 
-    if (ip > mz->length) {
+    if (ip >= mz->length) {
         warn_at("Attempt to scan past end of segment.\n");
         return;
     }
@@ -135,13 +177,17 @@ static void scan_segment(dword ip, struct mz *mz) {
         /* handle conditional and unconditional jumps */
         if (instr.op.flags & OP_BRANCH) {
             /* near relative jump, loop, or call */
-            if (!strcmp(instr.op.name, "call"))
-                mz->flags[instr.args[0].value] |= INSTR_FUNC;
-            else
-                mz->flags[instr.args[0].value] |= INSTR_JUMP;
-
-            /* scan it */
-            scan_segment(instr.args[0].value, mz);
+            if (instr.args[0].value >= mz->length)
+                warn_at("Branch target %#lx is past end of segment.\n", instr.args[0].value);
+            else {
+                if (!strcmp(instr.op.name, "call"))
+                    mz->flags[instr.args[0].value] |= INSTR_FUNC;
+                else
+                    mz->flags[instr.args[0].value] |= INSTR_JUMP;
+
+                /* scan it */
+                scan_segment(instr.args[0].value, mz);
+            }
         }
 
         if (instr.op.flags & OP_STOP)
@@ -154,16 +200,29 @@ static void scan_segment(dword ip, struct mz *mz) {
 }
 
 static void read_code(struct mz *mz) {
+    struct cache_array array;
+    struct cache_key key;
 
     mz->entry_point = realaddr(mz->header->e_cs, mz->header->e_ip);
     mz->length = ((mz->header->e_cp - 1) * 512) + mz->header->e_cblp;
     if (mz->header->e_cblp == 0) mz->length += 512;
     mz->flags = calloc(mz->length, sizeof(byte));
 
-    if (mz->entry_point > mz->length)
+    array.data = mz->flags;
+    array.size = mz->length;
+    if (cache_enabled() && cache_load(&key, &array, 1))
+        return;
+
+    if (mz->entry_point >= mz->length)
+    {
         warn("Entry point %05x exceeds segment length (%05x)\n", mz->entry_point, mz->length);
+        return;
+    }
     mz->flags[mz->entry_point] |= INSTR_FUNC;
     scan_segment(mz->entry_point, mz);
+
+    if (cache_enabled())
+        cache_store(&key, &array, 1);
 }
 
 void readmz(struct mz *mz) {
@@ -179,14 +238,45 @@ void readmz(struct mz *mz) {
 
 void freemz(struct mz *mz) {
     free(mz->flags);
+    arena_free(&file_arena);
+}
+
+/* DOS executables don't import anything, but it's still useful to group them
+ * together when clustering. */
+static void print_mz_import_hash(void)
+{
+    struct import_set set = {0};
+    byte digest[SHA256_DIGEST_SIZE];
+
+    import_set_hash(&set, digest);
+    print_import_hash(digest);
 }
 
 void dumpmz(void) {
     struct mz mz;
 
+    if (mode == CLUSTER) {
+        print_mz_import_hash();
+        return;
+    }
+
+    if (mode == VERSIONINFO) {
+        print_no_version_record();
+        return;
+    }
+
     readmz(&mz);
 
-    printf("Module type: MZ (DOS executable)\n");
+    if (output_format != FORMAT_TEXT) {
+        record_begin("module");
+        record_string("file", file_name);
+        record_string("format", "MZ");
+        record_end();
+    } else
+        fprintf(out, "Module type: MZ (DOS executable)\n");
+
+    if (mode & IMPORTHASH)
+        print_mz_import_hash();
 
     if (mode & DUMPHEADER)
         print_header(mz.header);
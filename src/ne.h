@@ -53,22 +53,16 @@ struct entry {
     char *name;     /* may be NULL */
 };
 
-struct export {
-    word ordinal;
-    char *name;
-};
-
 struct import_module {
     char *name;
-    struct export *exports;
-    unsigned export_count;
+    const char **exports;   /* indexed by ordinal; may be NULL */
+    unsigned export_count;  /* one more than the highest ordinal */
+    char *spec_data;        /* contents of the specfile, if we read one */
 };
 
 struct reloc {
     byte size;
     byte type;
-    word offset_count;
-    word *offsets;
     word tseg;
     word toffset;
     char *text;
@@ -83,6 +77,19 @@ struct segment {
     byte *instr_flags;
     struct reloc *reloc_table;
     word reloc_count;
+    word *reloc_map;    /* for each offset, index into reloc_table plus one */
+};
+
+/* A resource, as listed in the resource table. Names are not copied; they point
+ * to the length-prefixed strings in the table itself. */
+struct ne_resource {
+    word type;              /* with the high bit set if numeric */
+    const byte *type_name;  /* if not numeric */
+    word id;                /* with the high bit set if numeric */
+    const byte *id_name;    /* if not numeric */
+    dword offset;
+    dword length;
+    word flags;
 };
 
 struct ne {
@@ -98,13 +105,30 @@ struct ne {
     struct entry *enttab;
     unsigned entcount;
 
+    /* open-addressed index into enttab by (segment, offset); each slot holds
+     * an entry index plus one, or zero if empty */
+    unsigned *entry_index;
+    unsigned entry_index_mask;
+
     struct import_module *imptab;
 
     struct segment *segments;
+
+    struct ne_resource *resources;
+    unsigned resource_count;
 };
 
+static inline unsigned entry_hash(byte segment, word offset)
+{
+    /* multiplicative hash; offsets within a segment are often close together */
+    return (((dword)segment << 16) | offset) * 0x9e3779b1u;
+}
+
 /* in ne_resource.c */
-extern void print_rsrc(off_t start);
+extern void read_resources(off_t start, struct ne *ne);
+extern void print_rsrc(const struct ne *ne);
+extern void extract_rsrc(const struct ne *ne);
+extern void print_version_info(off_t start);
 /* in ne_segment.c */
 extern void read_segments(off_t start, struct ne *ne);
 extern void free_segments(struct ne *ne);
@@ -20,12 +20,18 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
+#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
 
 #include "semblance.h"
+#include "demangle.h"
+#include "imphash.h"
+#include "record.h"
+#include "specdb.h"
 #include "ne.h"
 
 static void print_flags(word flags){
@@ -52,7 +58,7 @@ static void print_flags(word flags){
     if (flags & 0x4000) strcat(buffer, ", non-conforming program");
     if (flags & 0x8000) strcat(buffer, ", library");
     
-    printf("Flags: 0x%04x (%s)\n", flags, buffer);
+    fprintf(out, "Flags: 0x%04x (%s)\n", flags, buffer);
 }
 
 static void print_os2flags(word flags){
@@ -67,9 +73,9 @@ static void print_os2flags(word flags){
         sprintf(buffer+strlen(buffer), ", (unknown flags 0x%04x)", flags & 0xfff0);
 
     if(buffer[0])
-        printf("OS/2 flags: 0x%04x (%s)\n", flags, buffer+2);
+        fprintf(out, "OS/2 flags: 0x%04x (%s)\n", flags, buffer+2);
     else
-        printf("OS/2 flags: 0x0000\n");
+        fprintf(out, "OS/2 flags: 0x0000\n");
 }
 
 static const char *const exetypes[] = {
@@ -82,6 +88,31 @@ static const char *const exetypes[] = {
     0
 };
 
+static void print_header_records(const struct header_ne *header)
+{
+    char buffer[12];
+
+    record_begin("header");
+    sprintf(buffer, "%d.%d", header->ne_ver, header->ne_rev);
+    record_string("linker_version", buffer);
+    record_uint("checksum", header->ne_crc);
+    record_uint("flags", header->ne_flags);
+    record_uint("autodata", header->ne_autodata);
+    record_uint("heap_size", header->ne_heap);
+    record_uint("stack_size", header->ne_stack);
+    record_far_address("entry_point", header->ne_cs, header->ne_ip);
+    record_far_address("stack", header->ne_ss, header->ne_sp);
+    if (header->ne_exetyp <= 5)
+        record_string("target_os", exetypes[header->ne_exetyp]);
+    else
+        record_uint("target_os", header->ne_exetyp);
+    record_uint("os2_flags", header->ne_flagsothers);
+    record_uint("swap_area", header->ne_swaparea);
+    sprintf(buffer, "%d.%d", header->ne_expver_maj, header->ne_expver_min);
+    record_string("windows_version", buffer);
+    record_end();
+}
+
 static void print_header(struct header_ne *header){
     /* Still need to deal with:
      *
@@ -90,38 +121,129 @@ static void print_header(struct header_ne *header){
      * 3a - offset to segment ref. bytes (same)
      */
 
-    putchar('\n');
-    printf("Linker version: %d.%d\n", header->ne_ver, header->ne_rev); /* 02 */
-    printf("Checksum: %08x\n", header->ne_crc); /* 08 */
+    if (output_format != FORMAT_TEXT) {
+        print_header_records(header);
+        return;
+    }
+
+    putc('\n', out);
+    fprintf(out, "Linker version: %d.%d\n", header->ne_ver, header->ne_rev); /* 02 */
+    fprintf(out, "Checksum: %08x\n", header->ne_crc); /* 08 */
     print_flags(header->ne_flags); /* 0c */
-    printf("Automatic data segment: %d\n", header->ne_autodata);
+    fprintf(out, "Automatic data segment: %d\n", header->ne_autodata);
     if (header->ne_unused != 0)
         warn("Header byte at position 0f has value 0x%02x.\n", header->ne_unused);
-    printf("Heap size: %d bytes\n", header->ne_heap); /* 10 */
-    printf("Stack size: %d bytes\n", header->ne_stack); /* 12 */
-    printf("Program entry point: %d:%04x\n", header->ne_cs, header->ne_ip); /* 14 */
-    printf("Initial stack location: %d:%04x\n", header->ne_ss, header->ne_sp); /* 18 */
+    fprintf(out, "Heap size: %d bytes\n", header->ne_heap); /* 10 */
+    fprintf(out, "Stack size: %d bytes\n", header->ne_stack); /* 12 */
+    fprintf(out, "Program entry point: %d:%04x\n", header->ne_cs, header->ne_ip); /* 14 */
+    fprintf(out, "Initial stack location: %d:%04x\n", header->ne_ss, header->ne_sp); /* 18 */
     if (header->ne_exetyp <= 5) /* 36 */
-        printf("Target OS: %s\n", exetypes[header->ne_exetyp]);
+        fprintf(out, "Target OS: %s\n", exetypes[header->ne_exetyp]);
     else
-        printf("Target OS: (unknown value %d)\n", header->ne_exetyp);
+        fprintf(out, "Target OS: (unknown value %d)\n", header->ne_exetyp);
     print_os2flags(header->ne_flagsothers); /* 37 */
-    printf("Swap area: %d\n", header->ne_swaparea); /* 3c */
-    printf("Expected Windows version: %d.%d\n", /* 3e */
+    fprintf(out, "Swap area: %d\n", header->ne_swaparea); /* 3c */
+    fprintf(out, "Expected Windows version: %d.%d\n", /* 3e */
            header->ne_expver_maj, header->ne_expver_min);
 }
 
+static void print_checksum(off_t offset_ne, const struct header_ne *header)
+{
+    dword crc = ne_checksum(offset_ne + offsetof(struct header_ne, ne_crc));
+
+    if (output_format != FORMAT_TEXT)
+    {
+        record_begin("checksum");
+        record_uint("stored", header->ne_crc);
+        record_uint("computed", crc);
+        record_end();
+    }
+    else if (!header->ne_crc)
+        fprintf(out, "Checksum: not set (computed %08x)\n", crc);
+    else if (header->ne_crc == crc)
+        fprintf(out, "Checksum: %08x (valid)\n", crc);
+    else
+        fprintf(out, "Checksum: %08x (mismatch, computed %08x)\n", header->ne_crc, crc);
+}
+
+static void print_ne_import_hash(off_t offset_ne, const struct ne *ne)
+{
+    off_t segtab = offset_ne + ne->header.ne_segtab;
+    struct import_set set = {0};
+    byte digest[SHA256_DIGEST_SIZE];
+    char name[256];
+    word i, j;
+
+    for (i = 0; i < ne->header.ne_cmod; i++)
+        import_set_add(&set, ne->imptab[i].name, NULL, -1);
+
+    /* Imported functions are only named by relocations, so walk the
+     * relocation tables directly instead of reading the segments. */
+    for (i = 0; i < ne->header.ne_cseg; i++)
+    {
+        off_t start = read_word(segtab + i * 8) << ne->header.ne_align;
+        word length = read_word(segtab + i * 8 + 2);
+        word flags = read_word(segtab + i * 8 + 4);
+        word count;
+
+        if (!(flags & 0x0100))
+            continue;
+
+        count = read_word(start + length);
+        for (j = 0; j < count; j++)
+        {
+            off_t entry = start + length + 2 + (j * 8);
+            byte type = read_byte(entry + 1) & 3;
+            word module = read_word(entry + 4);
+            word ordinal = read_word(entry + 6);
+
+            if ((type != 1 && type != 2) || !module || module > ne->header.ne_cmod)
+                continue;
+
+            if (type == 1)
+                import_set_add(&set, ne->imptab[module-1].name, NULL, ordinal);
+            else
+            {
+                sprintf(name, "%.*s", ne->nametab[ordinal], &ne->nametab[ordinal+1]);
+                import_set_add(&set, ne->imptab[module-1].name, name, -1);
+            }
+        }
+    }
+
+    import_set_hash(&set, digest);
+    print_import_hash(digest);
+}
+
+static void print_export_records(const struct ne *ne) {
+    int i;
+
+    for (i = 0; i < ne->entcount; i++) {
+        if (!ne->enttab[i].segment)
+            continue;
+        record_begin("export");
+        record_uint("ordinal", i + 1);
+        /* absolute values have no segment */
+        if (ne->enttab[i].segment == 0xfe)
+            record_uint("value", ne->enttab[i].offset);
+        else
+            record_far_address("address", ne->enttab[i].segment, ne->enttab[i].offset);
+        if (ne->enttab[i].name)
+            record_string("name", ne->enttab[i].name);
+        record_end();
+    }
+}
+
 static void print_export(struct ne *ne) {
     int i;
 
     for (i = 0; i < ne->entcount; i++)
         if (ne->enttab[i].segment == 0xfe)
             /* absolute value */
-            printf("\t%5d\t   %04x\t%s\n", i+1, ne->enttab[i].offset, ne->enttab[i].name ? ne->enttab[i].name : "<no name>");
+            fprintf(out, "\t%5d\t   %04x\t%s\n", i+1, ne->enttab[i].offset, ne->enttab[i].name ? ne->enttab[i].name : "<no name>");
         else if (ne->enttab[i].segment)
-            printf("\t%5d\t%2d:%04x\t%s\n", i+1, ne->enttab[i].segment,
+            fprintf(out, "\t%5d\t%2d:%04x\t%s\n", i+1, ne->enttab[i].segment,
                 ne->enttab[i].offset, ne->enttab[i].name ? ne->enttab[i].name : "<no name>");
-    putchar('\n');
+    putc('\n', out);
 }
 
 static void print_specfile(struct ne *ne) {
@@ -146,262 +268,36 @@ static void print_specfile(struct ne *ne) {
     fclose(specfile);
 }
 
-static int demangle_protection(char *buffer, char *start, char *prot, char *func) {
-    if (*start >= 'A' && *start <= 'V') {
-        if ((*start-'A') & 2)
-            strcat(buffer, "static ");
-        if ((*start-'A') & 4)
-            strcat(buffer, "virtual ");
-        if (!((*start-'A') & 1))
-            strcat(buffer, "near ");
-        if (((*start-'A') & 24) == 0)
-            strcat(buffer, "private ");
-        else if (((*start-'A') & 24) == 8)
-            strcat(buffer, "protected ");
-        else if (((*start-'A') & 24) == 16)
-            strcat(buffer, "public ");
-        *prot = *start;
-    } else if (*start == 'Y') {
-        strcat(buffer, "near ");
-    } else if (*start == 'Z') {
-        /* normally we'd mark far and not near, but most functions which
-         * are going to have an exported name will be far. */
-    } else if (*start == 'X') {
-        /* It's not clear what this means, but it always seems to be
-         * followed by either a number, or a string of text and then @. */
-        *prot = 'V'; /* just pretend that for now */
-        if (start[1] >= '0' && start[1] <= '9') {
-            strcat(buffer, "(X0) ");
-            buffer[strlen(buffer)-3] = start[1];
-            return 2;
-        } else {
-            return (strchr(start, '@')+1)-start;
-        }
-    } else if (*start == '_' && start[1] != '$') {
-#if 1
-        /* Same as above, but there is an extra character first (which
-         * is often V, so is likely to be the protection/etc), and then
-         * a number (often 7 or 3). */
-        demangle_protection(buffer, start+1, prot, func);
-        if (start[3] >= '0' && start[3] <= '9') {
-            strcat(buffer, "(_00) ");
-            buffer[strlen(buffer)-4] = start[2];
-            buffer[strlen(buffer)-3] = start[3];
-            return 4;
-        } else {
-            return (strchr(start, '@')+1)-start;
-        }
-#else
-        return 0;
-#endif
-    } else {
-        warn("Unknown modifier %c for function %s\n", *start, func);
-        return 0;
-    }
-    return 1;
-}
-
-static const char *int_types[] = {
-    "signed char",      /* C */
-    "char",             /* D */
-    "unsigned char",    /* E */
-    "short",            /* F */
-    "unsigned short",   /* G */
-    "int",              /* H */
-    "unsigned int",     /* I */
-    "long",             /* J */
-    "unsigned long",    /* K */
-};
-
-/* Returns the number of characters processed. */
-static int demangle_type(char **known_names, char *buffer, char *type) {
-    if (*type >= 'C' && *type <= 'K') {
-        strcat(buffer, int_types[*type-'C']);
-        strcat(buffer, " ");
-        return 1;
-    }
-
-    switch (*type) {
-    case 'A':
-    case 'P':
-    {
-        int ret;
-        if ((type[1]-'A') & 1)
-            strcat(buffer, "const ");
-        if ((type[1]-'A') & 2)
-            strcat(buffer, "volatile ");
-        ret = demangle_type(known_names, buffer, type+2);
-        if (!((type[1]-'A') & 4))
-            strcat(buffer, "near ");
-        strcat(buffer, (*type == 'A') ? "&" : "*");
-        return ret+2;
-    }
-    case 'M': strcat(buffer, "float "); return 1;
-    case 'N': strcat(buffer, "double "); return 1;
-    case 'U':
-    case 'V':
-    {
-        const char *p = buffer, *end;
-        unsigned int i;
-
-        if (type[1] >= '0' && type[1] <= '9')
-        {
-            strcat(buffer, known_names[type[1] - '0']);
-            strcat(buffer, " ");
-            return 3;
-        }
-
-        /* These represent structs (U) or types (V), but the name given
-         * doesn't seem to need a qualifier. */
-        /* something can go between the at signs, but what does it mean? */
-        end = strchr(strchr(type, '@')+1, '@');
-        if (end[-1] == '@')
-            strncat(buffer, type+1, (end-1)-(type+1));
-        else
-            strncat(buffer, type+1, end-(type+1));
-
-        for (i = 0; i < 10; ++i) {
-            if (!known_names[i]) {
-                known_names[i] = strdup(p);
-                break;
-            }
-        }
-        strcat(buffer, " ");
-        return (end+1)-type;
-    }
-    case 'X': strcat(buffer, "void "); return 1;
-    default: return 0;
-    }
-}
-
-/* Demangle a C++ function name. The scheme used seems to be mostly older
- * than any documented, but I was able to find documentation that is at
- * least close in Agner Fog's manual. */
-static char *demangle(char *func) {
-    char *known_types[10] = {}, *known_names[10] = {};
-    unsigned int known_type_idx = 0, known_name_idx = 0;
-    char buffer[1024];
-    char *p, *start, *end;
-    char prot = 0;
-    int len;
-
-    if (func[1] == '?')
-    {
-        /* TODO: constructor/destructor */
-        return func;
-    }
-
-    /* First populate the known names up to the function name. */
-    for (p = func; *p != '@' && known_name_idx < 10; p = strchr(p, '@') + 1)
-        known_names[known_name_idx++] = strndup(p, strchr(p, '@') - p);
-
-    /* Figure out the modifiers and calling convention. */
-    buffer[0] = 0;
-    p = strstr(func, "@@") + 2;
-    len = demangle_protection(buffer, p, &prot, func);
-    if (!len) {
-        return func;
-    }
-    p += len;
-
-    /* The next one seems to always be E or F. No idea why. */
-    if (prot >= 'A' && prot <= 'V' && !((prot-'A') & 2)) {
-        if (*p != 'E' && *p != 'F')
-            warn("Unknown modifier %c for function %s\n", *p, func);
-        p++;
-    }
-
-    /* This should mark the calling convention. Always seems to be A,
-     * but this corroborates the function body which uses CDECL. */
-    if (*p == 'A'); /* strcat(buffer, "__cdecl "); */
-    else if (*p == 'C') strcat(buffer, "__pascal ");
-    else warn("Unknown calling convention %c for function %s\n", *p, func);
-
-    /* This marks the return value. */
-    p++;
-    len = demangle_type(known_names, buffer, p);
-    if (!len) {
-        warn("Unknown return type %c for function %s\n", *p, func);
-        len = 1;
-    }
-    p += len;
-
-    /* Get the classname. This is in reverse order, so
-     * find the first @@ and work backwards from there. */
-    start = end = strstr(func, "@@");
-    while (1) {
-        start--;
-        while (*start != '?' && *start != '@') start--;
-        strncat(buffer, start+1, end-(start+1));
-        if (*start == '?') break;
-        strcat(buffer, "::");
-        end = start;
-    }
-
-    /* Print the arguments. */
-    if (*p == 'X') {
-        strcat(buffer, "(void)");
-    } else {
-        strcat(buffer, "(");
-        while (*p != '@') {
-            if (*p >= '0' && *p <= '9') {
-                strcat(buffer, known_types[*p - '0']);
-                p++;
-            } else {
-                const char *type = buffer + strlen(buffer);
-                len = demangle_type(known_names, buffer, p);
-                if (buffer[strlen(buffer)-1] == ' ')
-                    buffer[strlen(buffer)-1] = 0;
-                if (len > 1 && known_type_idx < 10)
-                    known_types[known_type_idx++] = strdup(type);
-                else if (!len) {
-                    warn("Unknown argument type %c for function %s\n", *p, func);
-                    len = 1;
-                }
-                p += len;
-            }
-            strcat(buffer, ", ");
-        }
-        buffer[strlen(buffer)-2] = ')';
-        buffer[strlen(buffer)-1] = 0;
-    }
-
-    func = realloc(func, (strlen(buffer)+1)*sizeof(char));
-    strcpy(func, buffer);
-
-    while (known_type_idx)
-        free(known_types[--known_type_idx]);
-    while (known_name_idx)
-        free(known_names[--known_name_idx]);
-    return func;
-}
-
 /* return the first entry (module name/desc) */
-static char *read_res_name_table(off_t start, struct entry *entry_table)
+static char *read_res_name_table(off_t start, struct ne *ne)
 {
     /* reads (non)resident names into our entry table */
     off_t cursor = start;
     byte length;
+    word ordinal;
     char *first;
     char *name;
 
     length = read_byte(cursor++);
-    first = malloc((length+1)*sizeof(char));
-    memcpy(first, read_data(cursor), length);
-    first[length] = 0;
+    first = arena_strndup(&file_arena, read_data(cursor), length);
     cursor += length + 2;
 
     while ((length = read_byte(cursor++)))
     {
-        name = malloc((length+1)*sizeof(char));
-        memcpy(name, read_data(cursor), length);
-        name[length] = 0;
+        name = arena_strndup(&file_arena, read_data(cursor), length);
         cursor += length;
 
-        if ((opts & DEMANGLE) && name[0] == '?')
-            name = demangle(name);
+        if ((opts & DEMANGLE) && name[0] == '?') {
+            const char *demangled = demangle(name, 0);
+            if (demangled != name)
+                name = arena_strndup(&file_arena, demangled, strlen(demangled));
+        }
 
-        entry_table[read_word(cursor) - 1].name = name;
+        ordinal = read_word(cursor);
+        if (ordinal && ordinal <= ne->entcount)
+            ne->enttab[ordinal - 1].name = name;
+        else
+            warn("Name %s has invalid ordinal %u.\n", name, ordinal);
         cursor += 2;
     }
 
@@ -425,7 +321,7 @@ static void get_entry_table(off_t start, struct ne *ne)
         if (index != 0)
             cursor += (index == 0xff ? 6 : 3) * length;
     }
-    ne->enttab = calloc(sizeof(struct entry), count);
+    ne->enttab = arena_calloc(&file_arena, count, sizeof(struct entry));
 
     count = 0;
     cursor = start;
@@ -456,70 +352,126 @@ static void get_entry_table(off_t start, struct ne *ne)
     ne->entcount = count;
 }
 
+/* Build a hash index of the entry table, so that we can find the name of a
+ * function from its address without scanning every entry. If more than one
+ * entry has the same address, the one with the lowest ordinal wins. */
+static void index_entry_table(struct ne *ne)
+{
+    unsigned size = 16, i, h;
+
+    while (size < ne->entcount * 2)
+        size *= 2;
+
+    ne->entry_index = arena_calloc(&file_arena, size, sizeof(*ne->entry_index));
+    ne->entry_index_mask = size - 1;
+
+    for (i = 0; i < ne->entcount; i++)
+    {
+        const struct entry *entry = &ne->enttab[i];
+
+        for (h = entry_hash(entry->segment, entry->offset) & ne->entry_index_mask;
+                ne->entry_index[h]; h = (h + 1) & ne->entry_index_mask)
+        {
+            const struct entry *other = &ne->enttab[ne->entry_index[h] - 1];
+            if (other->segment == entry->segment && other->offset == entry->offset)
+                break;
+        }
+        if (!ne->entry_index[h])
+            ne->entry_index[h] = i + 1;
+    }
+}
+
+/* The spec database is built alongside the program and installed to the
+ * package data directory. It's mapped once and shared by every file we dump. */
+static pthread_once_t specdb_once = PTHREAD_ONCE_INIT;
+
+static void open_specdb(void)
+{
+    const char *p;
+    char *path;
+
+    if ((p = strrchr(program_name, '/'))) {
+        path = malloc(p + 1 - program_name + sizeof("spec.db"));
+        memcpy(path, program_name, p + 1 - program_name);
+        strcpy(path + (p + 1 - program_name), "spec.db");
+        if (specdb_open(path)) {
+            free(path);
+            return;
+        }
+        free(path);
+    }
+    specdb_open(PKGDATADIR "/spec.db");
+}
+
+static char *read_specfile(FILE *specfile)
+{
+    char *data = NULL;
+    size_t size = 0, len = 0, ret;
+
+    do {
+        size = size ? size * 2 : 4096;
+        data = realloc(data, size);
+        ret = fread(data + len, 1, size - len - 1, specfile);
+        len += ret;
+    } while (len == size - 1);
+
+    data[len] = 0;
+    return data;
+}
+
 static void load_exports(struct import_module *module) {
     FILE *specfile;
     char *spec_name;
-    char line[300], *p;
-    int count;
-    word ordinal;
+    const dword *ordinals;
+    unsigned i;
+    char *p;
+
+    module->exports = NULL;
+    module->export_count = 0;
+    module->spec_data = NULL;
 
     spec_name = malloc(strlen(program_name) + strlen(module->name) + 10);
 
+    /* A specfile the user has written takes priority over the database. */
     sprintf(spec_name, "%s.ORD", module->name);
     specfile = fopen(spec_name, "r");
     if (!specfile) {
         sprintf(spec_name, "spec/%s.ORD", module->name);
         specfile = fopen(spec_name, "r");
     }
-    if (!specfile && (p = strrchr(program_name, '/'))) {
+
+    if (!specfile) {
+        pthread_once(&specdb_once, open_specdb);
+        if ((ordinals = specdb_find(module->name, &module->export_count))) {
+            module->exports = arena_alloc(&file_arena, module->export_count * sizeof(*module->exports));
+            for (i = 0; i < module->export_count; i++)
+                module->exports[i] = specdb_string(ordinals[i]);
+        }
+    }
+
+    if (!specfile && !module->exports && (p = strrchr(program_name, '/'))) {
         memcpy(spec_name, program_name, p + 1 - program_name);
         sprintf(spec_name + (p + 1 - program_name), "spec/%s.ORD", module->name);
         specfile = fopen(spec_name, "r");
     }
-    if (!specfile) {
+
+    if (specfile) {
+        module->spec_data = read_specfile(specfile);
+        module->exports = parse_specfile(module->spec_data, spec_name, &module->export_count);
+        fclose(specfile);
+    } else if (!module->exports) {
         fprintf(stderr, "Note: couldn't find specfile for module %s; exported names won't be given.\n", module->name);
         fprintf(stderr, "      To create a specfile, run `dumpne -o <module.dll>'.\n");
-        module->exports = NULL;
-        module->export_count = 0;
+        free(spec_name);
         return;
     }
+    free(spec_name);
 
-    /* first grab a count */
-    count = 0;
-    while (fgets(line, sizeof(line), specfile)) {
-        if (line[0] == '#' || line[0] == '\n') continue;
-        count++;
-    }
-
-    module->exports = malloc(count * sizeof(struct export));
-
-    fseek(specfile, 0, SEEK_SET);
-    count = 0;
-    while (fgets(line, sizeof(line), specfile)) {
-        if (line[0] == '#' || line[0] == '\n') continue;
-        if ((p = strchr(line, '\n'))) *p = 0;   /* kill final newline */
-        if (sscanf(line, "%hu", &ordinal) != 1) {
-            fprintf(stderr, "Error reading specfile near line: `%s'\n", line);
-            continue;
-        }
-        module->exports[count].ordinal = ordinal;
-
-        p = strchr(line, '\t');
-        if (p) {
-            p++;
-            module->exports[count].name = strdup(p);
-    
-            if ((opts & DEMANGLE) && module->exports[count].name[0] == '?')
-                module->exports[count].name = demangle(module->exports[count].name);
-        } else {
-            module->exports[count].name = NULL;
-        }
-        count++;
+    if (opts & DEMANGLE) {
+        for (i = 0; i < module->export_count; i++)
+            if (module->exports[i])
+                module->exports[i] = demangle(module->exports[i], 0);
     }
-
-    module->export_count = count;
-
-    fclose(specfile);
 }
 
 static void get_import_module_table(off_t start, struct ne *ne)
@@ -528,19 +480,18 @@ static void get_import_module_table(off_t start, struct ne *ne)
     byte length;
     unsigned i;
 
-    ne->imptab = malloc(ne->header.ne_cmod * sizeof(struct import_module));
+    ne->imptab = arena_alloc(&file_arena, ne->header.ne_cmod * sizeof(struct import_module));
     for (i = 0; i < ne->header.ne_cmod; i++) {
         offset = read_word(start + i * 2);
         length = ne->nametab[offset];
-        ne->imptab[i].name = malloc((length+1)*sizeof(char));
-        memcpy(ne->imptab[i].name, &ne->nametab[offset+1], length);
-        ne->imptab[i].name[length] = 0;
+        ne->imptab[i].name = arena_strndup(&file_arena, (const char *)&ne->nametab[offset+1], length);
 
         if (mode & DISASSEMBLE)
             load_exports(&ne->imptab[i]);
         else {
             ne->imptab[i].exports = NULL;
             ne->imptab[i].export_count = 0;
+            ne->imptab[i].spec_data = NULL;
         }
     }
 }
@@ -550,47 +501,61 @@ static void readne(off_t offset_ne, struct ne *ne) {
 
     /* read our various tables */
     get_entry_table(offset_ne + ne->header.ne_enttab, ne);
-    ne->name = read_res_name_table(offset_ne + ne->header.ne_restab, ne->enttab);
+    index_entry_table(ne);
+    ne->name = read_res_name_table(offset_ne + ne->header.ne_restab, ne);
     if (ne->header.ne_nrestab)
-        ne->description = read_res_name_table(ne->header.ne_nrestab, ne->enttab);
+        ne->description = read_res_name_table(ne->header.ne_nrestab, ne);
     else
         ne->description = NULL;
     ne->nametab = read_data(offset_ne + ne->header.ne_imptab);
     get_import_module_table(offset_ne + ne->header.ne_modtab, ne);
-    read_segments(offset_ne + ne->header.ne_segtab, ne);
-}
 
-static void freene(struct ne *ne) {
-    int i, j;
+    if ((mode & (DUMPRSRC | EXTRACT)) && ne->header.ne_rsrctab != ne->header.ne_restab)
+        read_resources(offset_ne + ne->header.ne_rsrctab, ne);
+    else {
+        ne->resources = NULL;
+        ne->resource_count = 0;
+    }
 
-    free(ne->name);
-    free(ne->description);
+    /* Reading the segments means scanning them, so don't bother unless we're
+     * going to print them. */
+    if (mode & DISASSEMBLE)
+        read_segments(offset_ne + ne->header.ne_segtab, ne);
+    else
+        ne->segments = NULL;
+}
 
-    /* free the entry table */
-    if (ne->enttab) {
-        for (i = 0; i < ne->entcount; i++)
-            free(ne->enttab[i].name);
-        free(ne->enttab);
-    }
+static void freene(struct ne *ne) {
+    int i;
 
-    /* free the import module table */
-    if (ne->imptab) {
-        for (i = 0; i < ne->header.ne_cmod; i++) {
-            free(ne->imptab[i].name);
-            for (j = 0; j < ne->imptab[i].export_count; j++)
-                free(ne->imptab[i].exports[j].name);
+    /* Exports read from a specfile point into its data. */
+    for (i = 0; i < ne->header.ne_cmod; i++) {
+        if (ne->imptab[i].spec_data) {
             free(ne->imptab[i].exports);
+            free(ne->imptab[i].spec_data);
         }
-        free(ne->imptab);
     }
 
-    free_segments(ne);
+    if (ne->segments)
+        free_segments(ne);
+
+    arena_free(&file_arena);
 }
 
 void dumpne(off_t offset_ne) {
     struct ne ne;
     int i;
 
+    if (mode == VERSIONINFO) {
+        const struct header_ne *header = read_data(offset_ne);
+
+        if (header->ne_rsrctab != header->ne_restab)
+            print_version_info(offset_ne + header->ne_rsrctab);
+        else
+            print_no_version_record();
+        return;
+    }
+
     readne(offset_ne, &ne);
 
     if (mode == SPECFILE) {
@@ -599,25 +564,55 @@ void dumpne(off_t offset_ne) {
         return;
     }
 
-    printf("Module type: NE (New Executable)\n");
-    printf("Module name: %s\n", ne.name);
-    if (ne.description)
-        printf("Module description: %s\n", ne.description);
+    if (mode == CLUSTER) {
+        print_ne_import_hash(offset_ne, &ne);
+        freene(&ne);
+        return;
+    }
+
+    if (output_format != FORMAT_TEXT) {
+        record_begin("module");
+        record_string("file", file_name);
+        record_string("format", "NE");
+        record_string("name", ne.name);
+        if (ne.description)
+            record_string("description", ne.description);
+        record_end();
+    } else {
+        fprintf(out, "Module type: NE (New Executable)\n");
+        fprintf(out, "Module name: %s\n", ne.name);
+        if (ne.description)
+            fprintf(out, "Module description: %s\n", ne.description);
+    }
+
+    if (mode & VERIFYSUM)
+        print_checksum(offset_ne, &ne.header);
+
+    if (mode & IMPORTHASH)
+        print_ne_import_hash(offset_ne, &ne);
 
     if (mode & DUMPHEADER)
         print_header(&ne.header);
 
-    if (mode & DUMPEXPORT) {
-        putchar('\n');
-        printf("Exports:\n");
+    if ((mode & DUMPEXPORT) && output_format != FORMAT_TEXT)
+        print_export_records(&ne);
+    else if (mode & DUMPEXPORT) {
+        putc('\n', out);
+        fprintf(out, "Exports:\n");
         print_export(&ne);
     }
 
-    if (mode & DUMPIMPORT) {
-        putchar('\n');
-        printf("Imported modules:\n");
+    if ((mode & DUMPIMPORT) && output_format != FORMAT_TEXT) {
+        for (i = 0; i < ne.header.ne_cmod; i++) {
+            record_begin("import");
+            record_string("module", ne.imptab[i].name);
+            record_end();
+        }
+    } else if (mode & DUMPIMPORT) {
+        putc('\n', out);
+        fprintf(out, "Imported modules:\n");
         for (i = 0; i < ne.header.ne_cmod; i++)
-            printf("\t%s\n", ne.imptab[i].name);
+            fprintf(out, "\t%s\n", ne.imptab[i].name);
     }
 
     if (mode & DISASSEMBLE)
@@ -625,10 +620,13 @@ void dumpne(off_t offset_ne) {
 
     if (mode & DUMPRSRC){
         if (ne.header.ne_rsrctab != ne.header.ne_restab)
-            print_rsrc(offset_ne + ne.header.ne_rsrctab);
-        else
-            printf("No resource table\n");
+            print_rsrc(&ne);
+        else if (output_format == FORMAT_TEXT)
+            fprintf(out, "No resource table\n");
     }
 
+    if (mode & EXTRACT)
+        extract_rsrc(&ne);
+
     freene(&ne);
 }
@@ -21,11 +21,14 @@
  */
 
 #include <ctype.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "semblance.h"
+#include "extract.h"
+#include "record.h"
 #include "ne.h"
 
 #pragma pack(1)
@@ -46,60 +49,51 @@ struct header_bitmap_info {
 
 STATIC_ASSERT(sizeof(struct header_bitmap_info) == 0x28);
 
-static char *dup_string_resource(off_t offset)
-{
-    byte length = read_byte(offset);
-    char *ret = malloc(length + 1);
-    memcpy(ret, read_data(offset + 1), length);
-    ret[length] = 0;
-    return ret;
-}
-
 /* length-indexed; returns  */
 static void print_escaped_string(off_t offset, long length){
-    putchar('"');
+    putc('"', out);
     while (length--){
         char c = read_byte(offset++);
         if (c == '\t')
-            printf("\\t");
+            fprintf(out, "\\t");
         else if (c == '\n')
-            printf("\\n");
+            fprintf(out, "\\n");
         else if (c == '\r')
-            printf("\\r");
+            fprintf(out, "\\r");
         else if (c == '"')
-            printf("\\\"");
+            fprintf(out, "\\\"");
         else if (c == '\\')
-            printf("\\\\");
+            fprintf(out, "\\\\");
         else if (c >= ' ' && c <= '~')
-            putchar(c);
+            putc(c, out);
         else
-            printf("\\x%02hhx", c);
+            fprintf(out, "\\x%02hhx", c);
     }
-    putchar('"');
+    putc('"', out);
 }
 
 /* null-terminated; returns the end of the string */
 static off_t print_escaped_string0(off_t offset)
 {
     char c;
-    putchar('"');
+    putc('"', out);
     while ((c = read_byte(offset++))){
         if (c == '\t')
-            printf("\\t");
+            fprintf(out, "\\t");
         else if (c == '\n')
-            printf("\\n");
+            fprintf(out, "\\n");
         else if (c == '\r')
-            printf("\\r");
+            fprintf(out, "\\r");
         else if (c == '"')
-            printf("\\\"");
+            fprintf(out, "\\\"");
         else if (c == '\\')
-            printf("\\\\");
+            fprintf(out, "\\\\");
         else if (c >= ' ' && c <= '~')
-            putchar(c);
+            putc(c, out);
         else
-            printf("\\x%02hhx", c);
+            fprintf(out, "\\x%02hhx", c);
     }
-    putchar('"');
+    putc('"', out);
     return offset;
 }
 
@@ -150,15 +144,15 @@ static const char *const rsrc_bmp_compression[] = {
 
 static void print_rsrc_flags(word flags){
     if (flags & 0x0004)
-        printf(", loaded"); /* should be runtime only... */
+        fprintf(out, ", loaded"); /* should be runtime only... */
     if (flags & 0x0010)
-        printf(", moveable");
+        fprintf(out, ", moveable");
     if (flags & 0x0020)
-        printf(", shareable");
+        fprintf(out, ", shareable");
     if (flags & 0x0040)
-        printf(", preloaded");
+        fprintf(out, ", preloaded");
     if (flags & 0x0200)
-        printf(", compressed"); /* no idea what this means */
+        fprintf(out, ", compressed"); /* no idea what this means */
     /* all resources I can find have the 0x0c00 bits set, and I can't find any
      * reference for what those mean.
      * there's a comment in newexe.h about how resource flags "ideally" match
@@ -166,9 +160,9 @@ static void print_rsrc_flags(word flags){
      * resources, but it's not out of the question that microsoft's compiler
      * just set those bits for both... */
     if (flags & 0x1000)
-        printf(", discardable");
+        fprintf(out, ", discardable");
     if (flags & 0xed8b)
-        printf(", (unknown flags 0x%04x)", flags & 0xed8b);
+        fprintf(out, ", (unknown flags 0x%04x)", flags & 0xed8b);
 }
 
 /* There are a lot of styles here and most of them would require longer
@@ -223,7 +217,7 @@ static void print_rsrc_dialog_style(dword flags){
             strcat(buffer, rsrc_dialog_style[i]);
         }
     }
-    printf("    Style: %s\n", buffer+2);
+    fprintf(out, "    Style: %s\n", buffer+2);
 }
 
 static const char *const rsrc_button_type[] = {
@@ -344,7 +338,7 @@ static void print_rsrc_control_style(byte class, dword flags){
     char buffer[1024];
     buffer[0] = 0;
 
-    printf("        Style: ");
+    fprintf(out, "        Style: ");
     
     switch (class){
     case 0x80: /* Button */
@@ -469,7 +463,7 @@ static void print_rsrc_control_style(byte class, dword flags){
         }
     }
 
-    printf("%s\n", (buffer[0] == ',') ? (buffer+2) : buffer);
+    fprintf(out, "%s\n", (buffer[0] == ',') ? (buffer+2) : buffer);
 }
 
 struct dialog_control {
@@ -502,13 +496,13 @@ static off_t print_rsrc_menu_items(int depth, off_t offset)
         flags = read_word(offset);
         offset += 2;
 
-        printf("        ");
-        for (i = 0; i < depth; i++) printf("  ");
+        fprintf(out, "        ");
+        for (i = 0; i < depth; i++) fprintf(out, "  ");
         if (!(flags & 0x0010)) {
             /* item ID */
             id = read_word(offset);
             offset += 2;
-            printf("%d: ", id);
+            fprintf(out, "%d: ", id);
         }
 
         offset = print_escaped_string0(offset);
@@ -527,8 +521,8 @@ static off_t print_rsrc_menu_items(int depth, off_t offset)
             sprintf(buffer+strlen(buffer), ", unknown flags 0x%04x", flags & 0xff00);
     
         if (buffer[0])
-            printf(" (%s)", buffer+2);
-        putchar('\n');
+            fprintf(out, " (%s)", buffer+2);
+        putc('\n', out);
 
         /* if we have a popup, recurse */
         if (flags & 0x0010)
@@ -624,9 +618,9 @@ static void print_rsrc_version_flags(struct version_header header){
     }
     if (header.flags_file & 0xffc0)
         sprintf(buffer+strlen(buffer), ", (unknown flags 0x%04x)", header.flags_file & 0xffc0);
-    printf("    File flags: ");
+    fprintf(out, "    File flags: ");
     if (header.flags_file)
-        printf("%s", buffer+2);
+        fprintf(out, "%s", buffer+2);
 
     buffer[0] = '\0';
     if (header.flags_os == 0)
@@ -648,29 +642,29 @@ static void print_rsrc_version_flags(struct version_header header){
         default: sprintf(buffer+strlen(buffer), ", (unknown OS 0x%04x)", header.flags_os >> 16);
         }
     }
-    printf("\n    OS flags: %s\n", buffer+2);
+    fprintf(out, "\n    OS flags: %s\n", buffer+2);
 
     if (header.flags_type <= 7)
-        printf("    Type: %s\n", rsrc_version_type[header.flags_type]);
+        fprintf(out, "    Type: %s\n", rsrc_version_type[header.flags_type]);
     else
-        printf("    Type: (unknown type %d)\n", header.flags_type);
+        fprintf(out, "    Type: (unknown type %d)\n", header.flags_type);
 
     if (header.flags_type == 3){ /* driver */
         if (header.flags_subtype <= 12)
-            printf("    Subtype: %s driver\n", rsrc_version_subtype_drv[header.flags_subtype]);
+            fprintf(out, "    Subtype: %s driver\n", rsrc_version_subtype_drv[header.flags_subtype]);
         else
-            printf("    Subtype: (unknown subtype %d)\n", header.flags_subtype);
+            fprintf(out, "    Subtype: (unknown subtype %d)\n", header.flags_subtype);
     } else if (header.flags_type == 4){ /* font */
-        if (header.flags_subtype == 0)      printf("    Subtype: unknown font\n");
-        else if (header.flags_subtype == 1) printf("    Subtype: raster font\n");
-        else if (header.flags_subtype == 2) printf("    Subtype: vector font\n");
-        else if (header.flags_subtype == 3) printf("    Subtype: TrueType font\n");
-        else printf("    Subtype: (unknown subtype %d)\n", header.flags_subtype);
+        if (header.flags_subtype == 0)      fprintf(out, "    Subtype: unknown font\n");
+        else if (header.flags_subtype == 1) fprintf(out, "    Subtype: raster font\n");
+        else if (header.flags_subtype == 2) fprintf(out, "    Subtype: vector font\n");
+        else if (header.flags_subtype == 3) fprintf(out, "    Subtype: TrueType font\n");
+        else fprintf(out, "    Subtype: (unknown subtype %d)\n", header.flags_subtype);
     } else if (header.flags_type == 5){ /* VXD */
-        printf("    Virtual device ID: %d\n", header.flags_subtype);
+        fprintf(out, "    Virtual device ID: %d\n", header.flags_subtype);
     } else if (header.flags_subtype){
         /* according to MSDN nothing else is valid */
-        printf("    Subtype: (unknown subtype %d)\n", header.flags_subtype);
+        fprintf(out, "    Subtype: (unknown subtype %d)\n", header.flags_subtype);
     }
 };
 
@@ -682,10 +676,10 @@ static void print_rsrc_strings(off_t offset, off_t end)
     {
         /* first length is redundant */
         length = read_word(offset + 2);
-        printf("        ");
+        fprintf(out, "        ");
         offset = print_escaped_string0(offset + 4);
         offset = (offset + 3) & ~3;
-        printf(": ");
+        fprintf(out, ": ");
         /* According to MSDN this is zero-terminated, and in most cases it is.
          * However, at least one application (msbsolar) has NEs with what
          * appears to be a non-zero-terminated string. In Windows this is cut
@@ -697,7 +691,7 @@ static void print_rsrc_strings(off_t offset, off_t end)
         print_escaped_string(offset, length ? length - 1 : 0);
         offset += length;
         offset = (offset + 3) & ~3;
-        putchar('\n');
+        putc('\n', out);
     }
 };
 
@@ -712,10 +706,15 @@ static void print_rsrc_stringfileinfo(off_t offset, off_t end)
     {
         /* StringTable header */
         length = read_word(offset);
+        if (!length)
+        {
+            warn("String table has zero length.\n");
+            break;
+        }
 
         /* codepage and language code */
         sscanf(read_data(offset + 4), "%4x%4x", &lang, &codepage);
-        printf("    String table (lang=%04x, codepage=%04x):\n", lang, codepage);
+        fprintf(out, "    String table (lang=%04x, codepage=%04x):\n", lang, codepage);
 
         print_rsrc_strings(offset + 16, offset + length);
         offset += length;
@@ -730,7 +729,7 @@ static void print_rsrc_varfileinfo(off_t offset, off_t end)
         word length = read_word(offset + 2), i;
         offset += 16;
         for (i = 0; i < length; i += 4)
-            printf("    Var (lang=%04x, codepage=%04x)\n", read_word(offset + i), read_word(offset + i + 2));
+            fprintf(out, "    Var (lang=%04x, codepage=%04x)\n", read_word(offset + i), read_word(offset + i + 2));
         offset += length;
     }
 };
@@ -740,7 +739,7 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
     switch (type)
     {
     case 0x8001: /* Cursor */
-        printf("    Hotspot: (%d, %d)\n", read_word(offset), read_word(offset + 2));
+        fprintf(out, "    Hotspot: (%d, %d)\n", read_word(offset), read_word(offset + 2));
         offset += 4;
         /* fall through */
 
@@ -748,26 +747,26 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
     case 0x8003: /* Icon */
         if (read_dword(offset) == 12) /* BITMAPCOREHEADER */
         {
-            printf("    Size: %dx%d\n", read_word(offset + 4), read_word(offset + 6));
-            printf("    Planes: %d\n", read_word(offset + 8));
-            printf("    Bit depth: %d\n", read_word(offset + 10));
+            fprintf(out, "    Size: %dx%d\n", read_word(offset + 4), read_word(offset + 6));
+            fprintf(out, "    Planes: %d\n", read_word(offset + 8));
+            fprintf(out, "    Bit depth: %d\n", read_word(offset + 10));
         }
         else if (read_dword(offset) == 40) /* BITMAPINFOHEADER */
         {
             const struct header_bitmap_info *header = read_data(offset);
-            printf("    Size: %dx%d\n", header->biWidth, header->biHeight / 2);
-            printf("    Planes: %d\n", header->biPlanes);
-            printf("    Bit depth: %d\n", header->biBitCount);
+            fprintf(out, "    Size: %dx%d\n", header->biWidth, header->biHeight / 2);
+            fprintf(out, "    Planes: %d\n", header->biPlanes);
+            fprintf(out, "    Bit depth: %d\n", header->biBitCount);
             if (header->biCompression <= 13 && rsrc_bmp_compression[header->biCompression])
-                printf("    Compression: %s\n", rsrc_bmp_compression[header->biCompression]);
+                fprintf(out, "    Compression: %s\n", rsrc_bmp_compression[header->biCompression]);
             else
-                printf("    Compression: (unknown value %d)\n", header->biCompression);
-            printf("    Resolution: %dx%d pixels/meter\n",
+                fprintf(out, "    Compression: (unknown value %d)\n", header->biCompression);
+            fprintf(out, "    Resolution: %dx%d pixels/meter\n",
                     header->biXPelsPerMeter, header->biYPelsPerMeter);
-            printf("    Colors used: %d", header->biClrUsed); /* todo: implied */
+            fprintf(out, "    Colors used: %d", header->biClrUsed); /* todo: implied */
             if (header->biClrImportant)
-                printf(" (%d marked important)", header->biClrImportant);
-            putchar('\n');
+                fprintf(out, " (%d marked important)", header->biClrImportant);
+            putc('\n', out);
         }
         else
             warn("Unknown bitmap header size %d.\n", read_dword(offset));
@@ -781,18 +780,18 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
             warn("Unknown menu version %d\n",extended);
             break;
         }
-        printf(extended ? "    Type: extended\n" : "    Type: standard\n");
+        fprintf(out, extended ? "    Type: extended\n" : "    Type: standard\n");
         if (read_word(offset + 2) != extended*4)
             warn("Unexpected offset value %d (expected %d).\n", read_word(offset + 2), extended * 4);
         offset += 4;
 
         if (extended)
         {
-            printf("    Help ID: %d\n", read_dword(offset));
+            fprintf(out, "    Help ID: %d\n", read_dword(offset));
             offset += 4;
         }
 
-        printf("    Items:\n");
+        fprintf(out, "    Items:\n");
         print_rsrc_menu_items(0, offset);
         break;
     }
@@ -803,25 +802,25 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
         dword style = read_dword(offset);
         print_rsrc_dialog_style(style);
         count = read_byte(offset + 4);
-        printf("    Position: (%d, %d)\n", read_word(offset + 5), read_word(offset + 7));
-        printf("    Size: %dx%d\n", read_word(offset + 9), read_word(offset + 11));
+        fprintf(out, "    Position: (%d, %d)\n", read_word(offset + 5), read_word(offset + 7));
+        fprintf(out, "    Size: %dx%d\n", read_word(offset + 9), read_word(offset + 11));
         if (read_byte(offset + 13) == 0xff){
-            printf("    Menu resource: #%d", read_word(offset + 14));
+            fprintf(out, "    Menu resource: #%d", read_word(offset + 14));
         } else {
-            printf("    Menu name: ");
+            fprintf(out, "    Menu name: ");
             offset = print_escaped_string0(offset + 13);
         }
-        printf("\n    Class name: ");
+        fprintf(out, "\n    Class name: ");
         offset = print_escaped_string0(offset);
-        printf("\n    Caption: ");
+        fprintf(out, "\n    Caption: ");
         offset = print_escaped_string0(offset);
         if (style & 0x00000040){ /* DS_SETFONT */
             font_size = read_word(offset);
-            printf("\n    Font: ");
+            fprintf(out, "\n    Font: ");
             offset = print_escaped_string0(offset + 2);
-            printf(" (%d pt)", font_size);
+            fprintf(out, " (%d pt)", font_size);
         }
-        putchar('\n');
+        putc('\n', out);
 
         while (count--){
             const struct dialog_control *control = read_data(offset);
@@ -829,30 +828,30 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
 
             if (control->class & 0x80){
                 if (control->class <= 0x85)
-                    printf("    %s", rsrc_dialog_class[control->class & (~0x80)]);
+                    fprintf(out, "    %s", rsrc_dialog_class[control->class & (~0x80)]);
                 else
-                    printf("    (unknown class %d)", control->class);
+                    fprintf(out, "    (unknown class %d)", control->class);
             }
             else
                 offset = print_escaped_string0(offset);
-            printf(" %d:\n", control->id);
+            fprintf(out, " %d:\n", control->id);
 
-            printf("        Position: (%d, %d)\n", control->x, control->y);
-            printf("        Size: %dx%d\n", control->width, control->height);
+            fprintf(out, "        Position: (%d, %d)\n", control->x, control->y);
+            fprintf(out, "        Size: %dx%d\n", control->width, control->height);
             print_rsrc_control_style(control->class, control->style);
 
             if (read_byte(offset) == 0xff){
                 /* todo: we can check the style for SS_ICON/SS_BITMAP and *maybe* also
                  * refer back to a printed RT_GROUPICON/GROUPCUROR/BITMAP resource. */
-                printf("        Resource: #%d", read_word(offset));
+                fprintf(out, "        Resource: #%d", read_word(offset));
                 offset += 3;
             } else {
-                printf("        Text: ");
+                fprintf(out, "        Text: ");
                 offset = print_escaped_string0(offset );
             }
             /* todo: WINE parses this as "data", but all of my testcases return 0. */
             /* read_byte(); */
-            putchar('\n');
+            putc('\n', out);
         }
     }
     break;
@@ -866,9 +865,9 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
             byte str_length = read_byte(cursor++);
             if (str_length)
             {
-                printf("    %3d (0x%06lx): ", i + ((rn_id & (~0x8000))-1)*16, cursor);
+                fprintf(out, "    %3d (0x%06lx): ", i + ((rn_id & (~0x8000))-1)*16, cursor);
                 print_escaped_string(cursor, str_length);
-                putchar('\n');
+                putc('\n', out);
                 cursor += str_length;
             }
             i++;
@@ -899,23 +898,23 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
             key = read_word();
             id = read_word();
 
-            printf("    ");
+            fprintf(out, "    ");
 
             if (flags & 0x02)
-                printf("(FNOINVERT) ");
+                fprintf(out, "(FNOINVERT) ");
 
             if (flags & 0x04)
-                printf("Shift+");
+                fprintf(out, "Shift+");
             if (flags & 0x08)
-                printf("Ctrl+");
+                fprintf(out, "Ctrl+");
             if (flags & 0x10)
-                printf("Alt+");
+                fprintf(out, "Alt+");
             if (flags & 0x60)
                 warn("Unknown accelerator flags 0x%02x\n", flags & 0x60);
 
             /* fixme: print the key itself */
 
-            printf(": %d\n", id);
+            fprintf(out, ": %d\n", id);
         } while (!(flags & 0x80));
     }
     break;
@@ -930,16 +929,16 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
          * is stored in the same bytes. */
         word count = read_word(offset + 4);
         offset += 6;
-        printf("    Resources: ");
+        fprintf(out, "    Resources: ");
         if (count--) {
-            printf("#%d", read_word(offset + 12));
+            fprintf(out, "#%d", read_word(offset + 12));
             offset += 14;
         }
         while (count--) {
-            printf(", #%d", read_word(offset + 12));
+            fprintf(out, ", #%d", read_word(offset + 12));
             offset += 14;
         }
-        printf("\n");
+        fprintf(out, "\n");
     }
     break;
     case 0x8010: /* Version */
@@ -957,15 +956,15 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
             warn("Version header version is %d.%d (expected 1.0).\n", header->struct_1, header->struct_2);
         print_rsrc_version_flags(*header);
 
-        printf("    File version:    %d.%d.%d.%d\n",
+        fprintf(out, "    File version:    %d.%d.%d.%d\n",
                header->file_1, header->file_2, header->file_3, header->file_4);
-        printf("    Product version: %d.%d.%d.%d\n",
+        fprintf(out, "    Product version: %d.%d.%d.%d\n",
                header->prod_1, header->prod_2, header->prod_3, header->prod_4);
 
         if (0) {
-        printf("    Created on: ");
+        fprintf(out, "    Created on: ");
         print_timestamp(header->date_1, header->date_2);
-        putchar('\n');
+        putc('\n', out);
         }
 
         offset += sizeof(struct version_header);
@@ -976,6 +975,11 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
             word value_length = read_word(offset + 2);
             const char *key = read_data(offset + 4);
 
+            if (!info_length)
+            {
+                warn("File info block has zero length.\n");
+                break;
+            }
             if (value_length)
                 warn("Value length is nonzero: %04x\n", value_length);
 
@@ -1001,22 +1005,22 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
         {
             len = min(offset + length - cursor, 16);
             
-            printf("    %lx:", cursor);
+            fprintf(out, "    %lx:", cursor);
             for (i=0; i<16; i++){
                 if (!(i & 1))
                     /* Since this is 16 bits, we put a space after (before) every other two bytes. */
-                    putchar(' ');
+                    putc(' ', out);
                 if (i<len)
-                    printf("%02x", read_byte(cursor + i));
+                    fprintf(out, "%02x", read_byte(cursor + i));
                 else
-                    printf("  ");
+                    fprintf(out, "  ");
             }
-            printf("  ");
+            fprintf(out, "  ");
             for (i=0; i<len; i++){
                 char c = read_byte(cursor + i);
-                putchar(isprint(c) ? c : '.');
+                putc(isprint(c) ? c : '.', out);
             }
-            putchar('\n');
+            putc('\n', out);
 
             cursor += len;
         }
@@ -1025,31 +1029,157 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
     }
 }
 
+/* The filters given with -a are compiled into a list of clauses. A
+ * resource is printed if it matches any clause. A filter matches a resource if
+ * it names its type, its ID, or its type followed by spaces and its ID, where
+ * the type and ID are compared case-insensitively to the strings we print.
+ * Since a type name can contain spaces, a filter gives one clause for each
+ * space it contains. */
+
+struct rsrc_clause {
+    int any_type;
+    word type;              /* numeric type this matches, or 0 */
+    const char *type_name;  /* string this matches a named type against */
+    size_t type_len;
+
+    int any_id;
+    word id;
+    const char *id_name;
+    size_t id_len;
+};
+
+struct rsrc_filter {
+    struct rsrc_clause *clauses;
+    unsigned count;
+};
+
+/* Which numeric type, if any, is printed as this string? */
+static word parse_rsrc_type(const char *str, size_t len)
+{
+    unsigned i, value = 0;
+
+    for (i = 0; i < rsrc_types_count; i++)
+    {
+        if (rsrc_types[i] && strlen(rsrc_types[i]) == len && !strncasecmp(rsrc_types[i], str, len))
+            return 0x8000 | i;
+    }
+
+    /* otherwise it's printed as "0x%04x" */
+    if (len != 6 || str[0] != '0' || tolower(str[1]) != 'x')
+        return 0;
+    for (i = 2; i < 6; i++)
+    {
+        if (!isxdigit(str[i]))
+            return 0;
+        value = (value << 4) | (isdigit(str[i]) ? str[i] - '0' : tolower(str[i]) - 'a' + 10);
+    }
+    if (!(value & 0x8000))
+        return 0;
+    if ((value & ~0x8000) < rsrc_types_count && rsrc_types[value & ~0x8000])
+        return 0;
+    return value;
+}
+
+/* Which numeric ID, if any, is printed as this string? */
+static word parse_rsrc_id(const char *str, size_t len)
+{
+    unsigned value = 0;
+    size_t i;
+
+    if (!len || len > 5 || (str[0] == '0' && len > 1))
+        return 0;
+    for (i = 0; i < len; i++)
+    {
+        if (!isdigit(str[i]))
+            return 0;
+        value = value * 10 + (str[i] - '0');
+    }
+    if (value > 0x7fff)
+        return 0;
+    return 0x8000 | value;
+}
+
+static void add_rsrc_clause(struct rsrc_filter *filter, const char *type, size_t type_len, const char *id)
+{
+    struct rsrc_clause *clause;
+
+    filter->clauses = realloc(filter->clauses, (filter->count + 1) * sizeof(*filter->clauses));
+    clause = &filter->clauses[filter->count++];
+
+    clause->any_type = !type;
+    if (type) {
+        clause->type = parse_rsrc_type(type, type_len);
+        clause->type_name = type;
+        clause->type_len = type_len;
+    }
+
+    clause->any_id = !id;
+    if (id) {
+        clause->id_len = strlen(id);
+        clause->id = parse_rsrc_id(id, clause->id_len);
+        clause->id_name = id;
+    }
+}
+
+/* The filters are options, which may change from one file to the next, so
+ * they're compiled again for each file. */
+static void compile_rsrc_filters(struct rsrc_filter *filter)
+{
+    const char *str, *p;
+    unsigned i;
+
+    filter->clauses = NULL;
+    filter->count = 0;
+
+    for (i = 0; i < resource_filters_count; ++i)
+    {
+        str = resource_filters[i];
+
+        add_rsrc_clause(filter, str, strlen(str), NULL);
+        add_rsrc_clause(filter, NULL, 0, str);
+
+        for (p = strchr(str, ' '); p; p = strchr(p + 1, ' '))
+        {
+            const char *id = p;
+            while (*id == ' ') ++id;
+            add_rsrc_clause(filter, str, p - str, id);
+        }
+    }
+}
+
+/* Compare a length-prefixed name from the resource table to a string. Names
+ * are compared as C strings, i.e. only up to an embedded null. */
+static int match_rsrc_name(const byte *name, const char *str, size_t len)
+{
+    const char *chars = (const char *)name + 1;
+    size_t name_len = strnlen(chars, name[0]);
+
+    return name_len == len && !strncasecmp(chars, str, len);
+}
+
 /* return true if this was one of the resources that was asked for */
-static int filter_resource(const char *type, const char *id){
+static int filter_resource(const struct rsrc_filter *filter, const struct ne_resource *rsrc)
+{
     unsigned i;
 
     if (!resource_filters_count)
         return 1;
 
-    for (i = 0; i < resource_filters_count; ++i){
-        const char *filter_type = resource_filters[i], *p;
-        size_t len = strlen(type);
-
-        /* note that both resource types and IDs are case insensitive */
+    for (i = 0; i < filter->count; ++i)
+    {
+        const struct rsrc_clause *clause = &filter->clauses[i];
 
-        /* if the filter is just a resource type or ID and we match that */
-        if (!strcasecmp(type, filter_type) || !strcasecmp(id, filter_type))
-            return 1;
+        if (!clause->any_type && !((rsrc->type & 0x8000)
+                ? rsrc->type == clause->type
+                : match_rsrc_name(rsrc->type_name, clause->type_name, clause->type_len)))
+            continue;
 
-        /* if the filter is a resource type followed by an ID and we match both */
-        if (strncasecmp(type, filter_type, len) || filter_type[len] != ' ')
+        if (!clause->any_id && !((rsrc->id & 0x8000)
+                ? rsrc->id == clause->id
+                : match_rsrc_name(rsrc->id_name, clause->id_name, clause->id_len)))
             continue;
 
-        p = filter_type + len;
-        while (*p == ' ') ++p;
-        if (!strcasecmp(id, p))
-            return 1;
+        return 1;
     }
     return 0;
 }
@@ -1073,15 +1203,46 @@ struct type_header
     struct resource resources[1];
 };
 
-void print_rsrc(off_t start){
+/* Get the type header at offset, making sure that it and its resources are
+ * inside the file. Returns NULL at the end of the table. */
+static const struct type_header *read_type_header(off_t offset)
+{
+    word count = read_word(offset + 2);
+
+    if (!read_word(offset))
+        return NULL;
+    if (!map_check(offset, offsetof(struct type_header, resources) + count * sizeof(struct resource)))
+        return NULL;
+    return read_data(offset);
+}
+
+static off_t next_type_header(off_t offset, const struct type_header *header)
+{
+    return offset + offsetof(struct type_header, resources) + header->count * sizeof(struct resource);
+}
+
+/* Read the resource table into an index, once. */
+void read_resources(off_t start, struct ne *ne)
+{
     const struct type_header *header;
     word align = read_word(start);
-    char *idstr;
+    unsigned count = 0;
+    off_t offset;
     word i;
 
-    header = read_data(start + sizeof(word));
+    offset = start + sizeof(word);
+    while ((header = read_type_header(offset)))
+    {
+        count += header->count;
+        offset = next_type_header(offset, header);
+    }
+
+    ne->resources = arena_alloc(&file_arena, count * sizeof(*ne->resources));
+    ne->resource_count = count;
 
-    while (header->type_id)
+    count = 0;
+    offset = start + sizeof(word);
+    while ((header = read_type_header(offset)))
     {
         if (header->resloader)
             warn("resloader is nonzero: %08x\n", header->resloader);
@@ -1089,50 +1250,306 @@ void print_rsrc(off_t start){
         for (i = 0; i < header->count; ++i)
         {
             const struct resource *rn = &header->resources[i];
+            struct ne_resource *rsrc = &ne->resources[count++];
+
+            rsrc->type = header->type_id;
+            rsrc->type_name = (header->type_id & 0x8000) ? NULL : read_data(start + header->type_id);
+            rsrc->id = rn->id;
+            rsrc->id_name = (rn->id & 0x8000) ? NULL : read_data(start + rn->id);
+            rsrc->offset = rn->offset << align;
+            rsrc->length = rn->length << align;
+            rsrc->flags = rn->flags;
+        }
 
-            if (rn->id & 0x8000){
-                idstr = malloc(6);
-                sprintf(idstr, "%d", rn->id & ~0x8000);
-            } else
-                idstr = dup_string_resource(start + rn->id);
+        offset = next_type_header(offset, header);
+    }
+}
 
-            if (header->type_id & 0x8000)
-            {
-                if ((header->type_id & (~0x8000)) < rsrc_types_count && rsrc_types[header->type_id & (~0x8000)]){
-                    if (!filter_resource(rsrc_types[header->type_id & ~0x8000], idstr))
-                        goto next;
-                    printf("\n%s", rsrc_types[header->type_id & ~0x8000]);
-                } else {
-                    char typestr[7];
-                    sprintf(typestr, "0x%04x", header->type_id);
-                    if (!filter_resource(typestr, idstr))
-                        goto next;
-                    printf("\n%s", typestr);
-                }
-            }
+/* For --version-info we don't read anything but the resource table, and stop
+ * at the first version resource. */
+void print_version_info(off_t start)
+{
+    const struct type_header *header;
+    word align = read_word(start);
+    off_t offset;
+
+    offset = start + sizeof(word);
+    while ((header = read_type_header(offset)))
+    {
+        if (header->type_id == 0x8010 && header->count)
+        {
+            print_version_record(header->resources[0].offset << align,
+                    header->resources[0].length << align, 0);
+            return;
+        }
+        offset = next_type_header(offset, header);
+    }
+
+    print_no_version_record();
+}
+
+/* Resources are listed as records, but not their contents. */
+static void print_rsrc_record(const struct ne_resource *rsrc)
+{
+    record_begin("resource");
+    if (!(rsrc->type & 0x8000))
+        record_stringn("resource_type", (const char *)rsrc->type_name + 1, rsrc->type_name[0]);
+    else if ((rsrc->type & (~0x8000)) < rsrc_types_count && rsrc_types[rsrc->type & (~0x8000)])
+        record_string("resource_type", rsrc_types[rsrc->type & ~0x8000]);
+    else
+        record_uint("resource_type", rsrc->type & ~0x8000);
+    if (rsrc->id & 0x8000)
+        record_uint("id", rsrc->id & ~0x8000);
+    else
+        record_stringn("name", (const char *)rsrc->id_name + 1, rsrc->id_name[0]);
+    record_uint("offset", rsrc->offset);
+    record_uint("length", rsrc->length);
+    record_uint("flags", rsrc->flags);
+    record_end();
+}
+
+void print_rsrc(const struct ne *ne)
+{
+    struct rsrc_filter filter;
+    unsigned i;
+
+    compile_rsrc_filters(&filter);
+
+    for (i = 0; i < ne->resource_count; ++i)
+    {
+        const struct ne_resource *rsrc = &ne->resources[i];
+
+        if (!filter_resource(&filter, rsrc))
+            continue;
+
+        if (output_format != FORMAT_TEXT)
+        {
+            print_rsrc_record(rsrc);
+            continue;
+        }
+
+        if (rsrc->type & 0x8000)
+        {
+            if ((rsrc->type & (~0x8000)) < rsrc_types_count && rsrc_types[rsrc->type & (~0x8000)])
+                fprintf(out, "\n%s", rsrc_types[rsrc->type & ~0x8000]);
             else
-            {
-                char *typestr = dup_string_resource(start + header->type_id);
-                if (!filter_resource(typestr, idstr))
-                {
-                    free(typestr);
-                    goto next;
-                }
-                printf("\n\"%s\"", typestr);
-                free(typestr);
-            }
+                fprintf(out, "\n0x%04x", rsrc->type);
+        }
+        else
+            fprintf(out, "\n\"%.*s\"", rsrc->type_name[0], rsrc->type_name + 1);
 
-            printf(" %s", idstr);
-            printf(" (offset = 0x%x, length = %d [0x%x]", rn->offset << align, rn->length << align, rn->length << align);
-            print_rsrc_flags(rn->flags);
-            printf("):\n");
+        if (rsrc->id & 0x8000)
+            fprintf(out, " %d", rsrc->id & ~0x8000);
+        else
+            fprintf(out, " %.*s", rsrc->id_name[0], rsrc->id_name + 1);
+        fprintf(out, " (offset = 0x%x, length = %d [0x%x]", rsrc->offset, rsrc->length, rsrc->length);
+        print_rsrc_flags(rsrc->flags);
+        fprintf(out, "):\n");
+
+        print_rsrc_resource(rsrc->type, rsrc->offset, rsrc->length, rsrc->id);
+    }
 
-            print_rsrc_resource(header->type_id, rn->offset << align, rn->length << align, rn->id);
+    free(filter.clauses);
+}
+
+/* Names of numeric types, as used in the names of extracted files. */
+static const char *const rsrc_file_types[] = {
+    0,
+    "cursor",           /* 1 */
+    "bitmap",           /* 2 */
+    "icon",             /* 3 */
+    "menu",             /* 4 */
+    "dialog",           /* 5 */
+    "string",           /* 6 */
+    "fontdir",          /* 7 */
+    "font",             /* 8 */
+    "accelerator",      /* 9 */
+    "rcdata",           /* a */
+    "messagetable",     /* b */
+    "group_cursor",     /* c */
+    0,
+    "group_icon",       /* e */
+    "nametable",        /* f */
+    "version",          /* 10 */
+};
+
+static const struct ne_resource *find_resource(const struct ne *ne, word type, word id)
+{
+    unsigned i;
 
-next:
-            free(idstr);
+    for (i = 0; i < ne->resource_count; ++i)
+    {
+        if (ne->resources[i].type == type && ne->resources[i].id == id)
+            return &ne->resources[i];
+    }
+    return NULL;
+}
+
+/* Fill in an icon directory entry from the bitmap header of an icon or cursor
+ * image. Returns the size of the image, or the given size if the header isn't
+ * one we recognize. */
+static dword get_image_info(off_t offset, dword size, struct extract_image *image)
+{
+    dword width, height, row, mask_row;
+    word bitcount, planes;
+    dword header_size = read_dword(offset), colors;
+
+    if (size < 40 || header_size != 40)
+        return size;
+
+    width = read_dword(offset + 4);
+    height = read_dword(offset + 8) / 2;
+    planes = read_word(offset + 12);
+    bitcount = read_word(offset + 14);
+    colors = read_dword(offset + 32);
+    if (!colors && bitcount <= 8)
+        colors = 1 << bitcount;
+
+    image->width = width;
+    image->height = height;
+    image->colors = colors < 256 ? colors : 0;
+    image->planes = planes;
+    image->bitcount = bitcount;
+
+    /* header, palette, color bits and mask bits */
+    row = ((width * bitcount + 31) / 32) * 4;
+    mask_row = ((width + 31) / 32) * 4;
+    return min(header_size + colors * 4 + (row + mask_row) * height, size);
+}
+
+static void extract_icon_rsrc(const struct ne_resource *rsrc, const char *type, const char *id)
+{
+    struct extract_image image = {0};
+
+    image.offset = rsrc->offset;
+    image.size = get_image_info(rsrc->offset, rsrc->length, &image);
+    extract_icon(type, id, 0, &image, 1);
+}
+
+/* A cursor resource starts with the hotspot, which goes into the directory
+ * entry of a cursor file. */
+static int get_cursor_image(off_t offset, dword size, struct extract_image *image)
+{
+    if (size < 4)
+        return 0;
+
+    memset(image, 0, sizeof(*image));
+    image->offset = offset + 4;
+    image->size = get_image_info(offset + 4, size - 4, image);
+    image->colors = 0;
+    image->planes = read_word(offset);
+    image->bitcount = read_word(offset + 2);
+    return 1;
+}
+
+static void extract_cursor_rsrc(const struct ne_resource *rsrc, const char *type, const char *id)
+{
+    struct extract_image image;
+
+    if (get_cursor_image(rsrc->offset, rsrc->length, &image))
+        extract_icon(type, id, 1, &image, 1);
+    else
+        extract_raw(type, id, rsrc->offset, rsrc->length);
+}
+
+/* A group icon or cursor is a directory of images stored as separate
+ * resources; put them all together into one file. */
+static void extract_group_rsrc(const struct ne *ne, const struct ne_resource *rsrc,
+        const char *type, const char *id, int cursor)
+{
+    word count = read_word(rsrc->offset + 4), i;
+    struct extract_image *images;
+    unsigned image_count = 0;
+
+    if (6 + count * 14 > rsrc->length) {
+        extract_raw(type, id, rsrc->offset, rsrc->length);
+        return;
+    }
+
+    images = calloc(count, sizeof(*images));
+    for (i = 0; i < count; ++i)
+    {
+        off_t entry = rsrc->offset + 6 + i * 14;
+        word image_id = read_word(entry + 12);
+        dword size = read_dword(entry + 8);
+        const struct ne_resource *image_rsrc;
+        struct extract_image *image = &images[image_count];
+
+        if (!(image_rsrc = find_resource(ne, cursor ? 0x8001 : 0x8003, image_id | 0x8000))) {
+            warn("Group %s refers to missing image %d.\n", id, image_id);
+            continue;
+        }
+
+        if (cursor) {
+            if (!get_cursor_image(image_rsrc->offset, min(size, image_rsrc->length), image))
+                continue;
+            image->width = read_word(entry);
+            image->height = read_word(entry + 2) / 2;
+        } else {
+            image->width = read_byte(entry);
+            image->height = read_byte(entry + 1);
+            image->colors = read_byte(entry + 2);
+            image->planes = read_word(entry + 4);
+            image->bitcount = read_word(entry + 6);
+            image->offset = image_rsrc->offset;
+            image->size = min(size, image_rsrc->length);
         }
+        image_count++;
+    }
+
+    extract_icon(type, id, cursor, images, image_count);
+    free(images);
+}
 
-        header = (struct type_header *)(&header->resources[header->count]);
+void extract_rsrc(const struct ne *ne)
+{
+    struct rsrc_filter filter;
+    char type[64], id[64];
+    unsigned i;
+
+    compile_rsrc_filters(&filter);
+
+    for (i = 0; i < ne->resource_count; ++i)
+    {
+        const struct ne_resource *rsrc = &ne->resources[i];
+
+        if (!filter_resource(&filter, rsrc))
+            continue;
+
+        if (!(rsrc->type & 0x8000))
+            extract_sanitize(type, sizeof(type), (const char *)rsrc->type_name + 1, rsrc->type_name[0]);
+        else if ((rsrc->type & ~0x8000) < sizeof(rsrc_file_types) / sizeof(rsrc_file_types[0]) && rsrc_file_types[rsrc->type & ~0x8000])
+            strcpy(type, rsrc_file_types[rsrc->type & ~0x8000]);
+        else
+            sprintf(type, "%d", rsrc->type & ~0x8000);
+
+        if (rsrc->id & 0x8000)
+            sprintf(id, "%d", rsrc->id & ~0x8000);
+        else
+            extract_sanitize(id, sizeof(id), (const char *)rsrc->id_name + 1, rsrc->id_name[0]);
+
+        switch (rsrc->type)
+        {
+        case 0x8001: /* Cursor */
+            extract_cursor_rsrc(rsrc, type, id);
+            break;
+        case 0x8002: /* Bitmap */
+            extract_bitmap(type, id, rsrc->offset, rsrc->length);
+            break;
+        case 0x8003: /* Icon */
+            extract_icon_rsrc(rsrc, type, id);
+            break;
+        case 0x800c: /* Cursor directory */
+            extract_group_rsrc(ne, rsrc, type, id, 1);
+            break;
+        case 0x800e: /* Icon directory */
+            extract_group_rsrc(ne, rsrc, type, id, 0);
+            break;
+        default:
+            extract_raw(type, id, rsrc->offset, rsrc->length);
+            break;
+        }
     }
+
+    free(filter.clauses);
 }
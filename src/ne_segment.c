@@ -26,7 +26,11 @@
 #include <string.h>
 
 #include "semblance.h"
+#include "cache.h"
+#include "index.h"
+#include "record.h"
 #include "ne.h"
+#include "where.h"
 #include "x86_instr.h"
 
 #ifdef USE_WARN
@@ -39,38 +43,37 @@
 
 /* index function */
 static char *get_entry_name(word cs, word ip, const struct ne *ne) {
-    unsigned i;
-    for (i=0; i<ne->entcount; i++) {
-        if (ne->enttab[i].segment == cs &&
-            ne->enttab[i].offset == ip)
-            return ne->enttab[i].name;
+    unsigned h, i;
+
+    if (cs > 0xff) return NULL;
+
+    for (h = entry_hash(cs, ip) & ne->entry_index_mask; (i = ne->entry_index[h]);
+            h = (h + 1) & ne->entry_index_mask) {
+        if (ne->enttab[i-1].segment == cs &&
+            ne->enttab[i-1].offset == ip)
+            return ne->enttab[i-1].name;
     }
     return NULL;
 }
 
 /* index function */
 static const struct reloc *get_reloc(const struct segment *seg, word ip) {
-    unsigned i, o;
-    for (i = 0; i < seg->reloc_count; i++) {
-        for (o = 0; o < seg->reloc_table[i].offset_count; o++)
-            if (seg->reloc_table[i].offsets[o] == ip)
-                return &seg->reloc_table[i];
-    }
-    return NULL;
+    if (!seg->reloc_map || ip >= seg->length || !seg->reloc_map[ip])
+        return NULL;
+    return &seg->reloc_table[seg->reloc_map[ip]-1];
 }
 
 /* load an imported name from a specfile */
-static char *get_imported_name(word module, word ordinal, const struct ne *ne) {
-    unsigned i;
-    for (i=0; i<ne->imptab[module-1].export_count; i++) {
-        if (ne->imptab[module-1].exports[i].ordinal == ordinal)
-            return ne->imptab[module-1].exports[i].name;
-    }
-    return NULL;
+static const char *get_imported_name(word module, word ordinal, const struct ne *ne) {
+    if (ordinal >= ne->imptab[module-1].export_count)
+        return NULL;
+    return ne->imptab[module-1].exports[ordinal];
 }
 
-/* Tweak the inline string and return the comment. */
-static const char *relocate_arg(const struct segment *seg, struct arg *arg, const struct ne *ne)
+/* Tweak the inline string and return the comment. What the argument refers to
+ * is added to refs, for --where. */
+static const char *relocate_arg(const struct segment *seg, struct arg *arg, const struct ne *ne,
+        struct where_refs *refs)
 {
     const struct reloc *r = get_reloc(seg, arg->ip);
     char *module = NULL;
@@ -81,12 +84,15 @@ static const char *relocate_arg(const struct segment *seg, struct arg *arg, cons
         return "?";
     }
 
-    if (r->type == 1 || r->type == 2)
+    if (r->type == 1 || r->type == 2) {
         module = ne->imptab[r->tseg-1].name;
+        refs->import = 1;
+    }
 
     if (arg->type == SEGPTR && r->size == 3) {
         /* 32-bit relocation on 32-bit pointer, so just copy the name */
         if (r->type == 0) {
+            where_add_target(refs, r->tseg, r->toffset);
             snprintf(arg->string, sizeof(arg->string), "%d:%04x", r->tseg, r->toffset);
             return r->text;
         } else if (r->type == 1) {
@@ -100,6 +106,7 @@ static const char *relocate_arg(const struct segment *seg, struct arg *arg, cons
     } else if (arg->type == SEGPTR && r->size == 2 && r->type == 0) {
         /* segment relocation on 32-bit pointer; copy the segment but keep the
          * offset */
+        where_add_target(refs, r->tseg, arg->value);
         snprintf(arg->string, sizeof(arg->string), "%d:%04lx", r->tseg, arg->value);
         return get_entry_name(r->tseg, arg->value, ne);
     } else if ((arg->type == IMM || arg->type == MEM) && (r->size == 2 || r->size == 5)) {
@@ -135,6 +142,7 @@ static const char *relocate_arg(const struct segment *seg, struct arg *arg, cons
 static int print_ne_instr(const struct segment *seg, word ip, byte *p, const struct ne *ne) {
     word cs = seg->cs;
     struct instr instr = {0};
+    struct where_refs refs = {0};
     unsigned len;
     int bits = (seg->flags & 0x2000) ? 32 : 16;
 
@@ -143,22 +151,27 @@ static int print_ne_instr(const struct segment *seg, word ip, byte *p, const str
 
     len = get_instr(ip, p, &instr, bits);
 
-    sprintf(ip_string, "%3d:%04x", seg->cs, ip);
-
     /* check for relocations */
     if (seg->instr_flags[instr.args[0].ip] & INSTR_RELOC)
-        comment = relocate_arg(seg, &instr.args[0], ne);
+        comment = relocate_arg(seg, &instr.args[0], ne, &refs);
     if (seg->instr_flags[instr.args[1].ip] & INSTR_RELOC)
-        comment = relocate_arg(seg, &instr.args[1], ne);
+        comment = relocate_arg(seg, &instr.args[1], ne, &refs);
     /* make sure to check for SEGPTR segment-only relocations */
     if (instr.op.arg0 == SEGPTR && seg->instr_flags[instr.args[0].ip+2] & INSTR_RELOC)
-        comment = relocate_arg(seg, &instr.args[0], ne);
+        comment = relocate_arg(seg, &instr.args[0], ne, &refs);
 
     /* check if we are referencing a named export */
     if (!comment && instr.op.arg0 == REL)
         comment = get_entry_name(cs, instr.args[0].value, ne);
 
-    print_instr(ip_string, p, len, seg->instr_flags[ip], &instr, comment, bits);
+    if (where_enabled()) {
+        where_add_operands(&refs, &instr, cs, ip + len);
+        if (!where_match(&instr, &refs))
+            return len;
+    }
+
+    sprintf(ip_string, "%3d:%04x", seg->cs, ip);
+    print_instr(ip_string, cs, ip, p, len, seg->instr_flags[ip], &instr, comment, bits);
 
     return len;
 };
@@ -169,24 +182,26 @@ static void print_disassembly(const struct segment *seg, const struct ne *ne) {
 
     byte buffer[MAX_INSTR];
 
-    while (ip < seg->length) {
+    while (ip < seg->length && ip < seg->min_alloc) {
         /* find a valid instruction */
         if (!(seg->instr_flags[ip] & INSTR_VALID)) {
             if (opts & DISASSEMBLE_ALL) {
                 /* still skip zeroes */
                 if (read_byte(seg->start + ip) == 0)
                 {
-                    printf("     ...\n");
+                    if (output_format == FORMAT_TEXT && !where_enabled())
+                        fprintf(out, "     ...\n");
                     ip++;
-                    while (read_byte(seg->start + ip) == 0) ip++;
+                    while (ip < seg->length && read_byte(seg->start + ip) == 0) ip++;
                 }
             } else {
-                printf("     ...\n");
-                while ((ip < seg->length) && !(seg->instr_flags[ip] & INSTR_VALID)) ip++;
+                if (output_format == FORMAT_TEXT && !where_enabled())
+                    fprintf(out, "     ...\n");
+                while ((ip < seg->length) && (ip < seg->min_alloc) && !(seg->instr_flags[ip] & INSTR_VALID)) ip++;
             }
         }
 
-        if (ip >= seg->length) return;
+        if (ip >= seg->length || ip >= seg->min_alloc) return;
 
         /* Instructions can "hang over" the end of a segment.
          * Zero should be supplied. */
@@ -195,15 +210,25 @@ static void print_disassembly(const struct segment *seg, const struct ne *ne) {
 
         if (seg->instr_flags[ip] & INSTR_FUNC) {
             char *name = get_entry_name(cs, ip, ne);
-            printf("\n");
-            printf("%d:%04x <%s>:\n", cs, ip, name ? name : "no name");
+            if (output_format != FORMAT_TEXT) {
+                index_function(name, cs, ip);
+                record_begin("function");
+                record_far_address("address", cs, ip);
+                if (name) record_string("name", name);
+                record_end();
+            } else {
+                fprintf(out, "\n");
+                index_function(name, cs, ip);
+                fprintf(out, "%d:%04x <%s>:\n", cs, ip, name ? name : "no name");
+            }
             /* don't mark far functions—we can't reliably detect them
              * because of "push cs", and they should be evident anyway. */
         }
 
         ip += print_ne_instr(seg, ip, buffer, ne);
     }
-    putchar('\n');
+    if (output_format == FORMAT_TEXT)
+        putc('\n', out);
 }
 
 static void print_data(const struct segment *seg) {
@@ -213,20 +238,20 @@ static void print_data(const struct segment *seg) {
         int len = min(seg->length-ip, 16);
         int i;
 
-        printf("%3d:%04x", seg->cs, ip);
+        fprintf(out, "%3d:%04x", seg->cs, ip);
         for (i=0; i<16; i++) {
             if (i < len)
-                printf(" %02x", read_byte(seg->start + ip + i));
+                fprintf(out, " %02x", read_byte(seg->start + ip + i));
             else
-                printf("   ");
+                fprintf(out, "   ");
         }
-        printf("  ");
+        fprintf(out, "  ");
         for (i = 0; i < len; ++i)
         {
             char c = read_byte(seg->start + ip + i);
-            putchar(isprint(c) ? c : '.');
+            putc(isprint(c) ? c : '.', out);
         }
-        putchar('\n');
+        putc('\n', out);
     }
 }
 
@@ -238,7 +263,7 @@ static void scan_segment(word cs, word ip, struct ne *ne) {
     int instr_length;
     int i;
 
-    if (ip >= seg->length) {
+    if (ip >= seg->length || ip >= seg->min_alloc) {
         warn_at("Attempt to scan past end of segment.\n");
         return;
     }
@@ -246,7 +271,7 @@ static void scan_segment(word cs, word ip, struct ne *ne) {
     if ((seg->instr_flags[ip] & (INSTR_VALID|INSTR_SCANNED)) == INSTR_SCANNED)
         warn_at("Attempt to scan byte that does not begin instruction.\n");
 
-    while (ip < seg->length) {
+    while (ip < seg->length && ip < seg->min_alloc) {
         /* check if we already read from here */
         if (seg->instr_flags[ip] & INSTR_SCANNED) return;
 
@@ -270,11 +295,12 @@ static void scan_segment(word cs, word ip, struct ne *ne) {
                     const struct segment *tseg;
 
                     if (!r) break;
-                    tseg = &ne->segments[r->tseg-1];
-
                     if (r->type != 0) break;
+                    if (!r->tseg || r->tseg > ne->header.ne_cseg) break;
 
-                    if (r->size == 3) {
+                    tseg = &ne->segments[r->tseg-1];
+
+                    if (r->size == 3 && r->toffset < tseg->min_alloc) {
                         /* 32-bit relocation on 32-bit pointer */
                         tseg->instr_flags[r->toffset] |= INSTR_FAR;
                         if (!strcmp(instr.op.name, "call"))
@@ -282,7 +308,7 @@ static void scan_segment(word cs, word ip, struct ne *ne) {
                         else
                             tseg->instr_flags[r->toffset] |= INSTR_JUMP;
                         scan_segment(r->tseg, r->toffset, ne);
-                    } else if (r->size == 2) {
+                    } else if (r->size == 2 && instr.args[0].value < tseg->min_alloc) {
                         /* segment relocation on 32-bit pointer */
                         tseg->instr_flags[instr.args[0].value] |= INSTR_FAR;
                         if (!strcmp(instr.op.name, "call"))
@@ -355,7 +381,7 @@ static void print_segment_flags(word flags) {
     if (flags & 0x2000) strcat(buffer, ", 32-bit");
 
     if (flags & 0xc000) sprintf(buffer+strlen(buffer), ", (unknown flags 0x%04x)", flags & 0xc000);
-    printf("    Flags: 0x%04x (%s)\n", flags, buffer);
+    fprintf(out, "    Flags: 0x%04x (%s)\n", flags, buffer);
 }
 
 static void read_reloc(const struct segment *seg, word index, struct ne *ne)
@@ -381,6 +407,11 @@ static void read_reloc(const struct segment *seg, word index, struct ne *ne)
         char *name;
 
         if (module == 0xff) {
+            if (!ordinal || ordinal > ne->entcount) {
+                warn("%d: Relocation to invalid entry %u.\n", seg->cs, ordinal);
+                r->type = 3;
+                return;
+            }
             r->tseg = ne->enttab[ordinal-1].segment;
             r->toffset = ne->enttab[ordinal-1].offset;
         } else {
@@ -391,6 +422,10 @@ static void read_reloc(const struct segment *seg, word index, struct ne *ne)
         /* grab the name, if we can */
         if ((name = get_entry_name(r->tseg, r->toffset, ne)))
             r->text = name;
+    } else if (!module || module > ne->header.ne_cmod) {
+        warn("%d: Relocation to invalid module %u.\n", seg->cs, module);
+        r->type = 3;
+        return;
     } else if ((type & 3) == 1) {
         /* imported ordinal */
 
@@ -412,9 +447,8 @@ static void read_reloc(const struct segment *seg, word index, struct ne *ne)
     if (size != 2 && size != 3 && size != 5)
         warn("%d: Relocation with unknown size %#x.\n", seg->cs, size);
 
-    /* get the offset list */
+    /* walk the offset list, recording each offset in the map */
     offset_cursor = offset;
-    r->offset_count = 0;
     do {
         /* One of my testcases has relocation offsets that exceed the length of
          * the segment. Until we figure out what that's about, ignore them. */
@@ -425,12 +459,24 @@ static void read_reloc(const struct segment *seg, word index, struct ne *ne)
 
         if (seg->instr_flags[offset_cursor] & INSTR_RELOC) {
             warn("%d:%04x: Infinite loop reading relocation data.\n", seg->cs, offset_cursor);
-            r->offset_count = 0;
+            /* Walk the chain again to forget the offsets we've already
+             * recorded. It stops where it reaches an offset that isn't ours,
+             * which is either where we stopped above or one we've just
+             * cleared. */
+            offset_cursor = offset;
+            while (offset_cursor < seg->length && seg->reloc_map[offset_cursor] == index + 1) {
+                seg->reloc_map[offset_cursor] = 0;
+                next = read_word(seg->start + offset_cursor);
+                if (type & 4)
+                    offset_cursor += next;
+                else
+                    offset_cursor = next;
+            }
             return;
         }
 
-        r->offset_count++;
         seg->instr_flags[offset_cursor] |= INSTR_RELOC;
+        seg->reloc_map[offset_cursor] = index + 1;
 
         next = read_word(seg->start + offset_cursor);
         if (type & 4)
@@ -442,49 +488,69 @@ static void read_reloc(const struct segment *seg, word index, struct ne *ne)
         else
             offset_cursor = next;
     } while (next < 0xfffb);
+}
 
-    r->offsets = malloc(r->offset_count*sizeof(word *));
+static void scan_entry_points(struct ne *ne)
+{
+    word entry_cs = ne->header.ne_cs;
+    word entry_ip = ne->header.ne_ip;
+    word count = ne->header.ne_cseg;
+    word i;
 
-    offset_cursor = offset;
-    r->offset_count = 0;
-    do {
-        if (offset_cursor >= seg->length) {
-            break;
-        }
+    /* Scan entry points (we have to do this after we read relocation data for
+     * all segments.) */
+    for (i = 0; i < ne->entcount; i++) {
 
-        r->offsets[r->offset_count] = offset_cursor;
-        r->offset_count++;
+        /* don't scan exported values */
+        if (ne->enttab[i].segment == 0 ||
+            ne->enttab[i].segment == 0xfe) continue;
 
-        next = read_word(seg->start + offset_cursor);
-        if (type & 4)
-        {
-            if (!next)
-                break;
-            offset_cursor += next;
+        /* or values that point nowhere */
+        if (ne->enttab[i].segment > count
+                || ne->enttab[i].offset >= ne->segments[ne->enttab[i].segment-1].min_alloc) {
+            warn("Entry %u (%u:%04x) is outside of any segment.\n",
+                    i + 1, ne->enttab[i].segment, ne->enttab[i].offset);
+            continue;
         }
-        else
-            offset_cursor = next;
-    } while (next < 0xfffb);
-}
 
-static void free_reloc(struct reloc *reloc_data, word reloc_count) {
-    int i;
-    for (i = 0; i < reloc_count; i++) {
-        free(reloc_data[i].offsets);
+        /* or values that live in data segments */
+        if (ne->segments[ne->enttab[i].segment-1].flags & 0x0001) continue;
+
+        /* Annoyingly, data can be put in code segments, and without any
+         * apparent indication that it is not code. As a dumb heuristic,
+         * only scan exported entries—this won't work universally, and it
+         * may potentially miss private entries, but it's better than nothing. */
+        if (!(ne->enttab[i].flags & 1)) continue;
+
+        scan_segment(ne->enttab[i].segment, ne->enttab[i].offset, ne);
+        ne->segments[ne->enttab[i].segment-1].instr_flags[ne->enttab[i].offset] |= INSTR_FUNC;
     }
 
-    free(reloc_data);
+    /* and don't forget to scan the program entry point */
+    if (entry_cs == 0 && entry_ip == 0) {
+        /* do nothing */
+    } else if (entry_cs == 0 || entry_cs > count) {
+        warn("Entry point %d:%04x is not in a segment\n", entry_cs, entry_ip);
+    } else if (entry_ip >= ne->segments[entry_cs-1].length) {
+        /* see note above under relocations */
+        warn("Entry point %d:%04x exceeds segment length (%04x)\n", entry_cs, entry_ip, ne->segments[entry_cs-1].length);
+    } else {
+        ne->segments[entry_cs-1].instr_flags[entry_ip] |= INSTR_FUNC;
+        scan_segment(entry_cs, entry_ip, ne);
+    }
 }
 
 void read_segments(off_t start, struct ne *ne)
 {
-    word entry_cs = ne->header.ne_cs;
-    word entry_ip = ne->header.ne_ip;
     word count = ne->header.ne_cseg;
+    struct cache_array *arrays;
+    struct cache_key key;
     struct segment *seg;
     word i, j;
 
-    ne->segments = malloc(count * sizeof(struct segment));
+    map_set_phase(MAP_SCAN);
+
+    ne->segments = arena_alloc(&file_arena, count * sizeof(struct segment));
 
     for (i = 0; i < count; ++i)
     {
@@ -506,46 +572,33 @@ void read_segments(off_t start, struct ne *ne)
 
         if (seg->flags & 0x0100) {
             seg->reloc_count = read_word(seg->start + seg->length);
-            seg->reloc_table = malloc(seg->reloc_count * sizeof(struct reloc));
+            seg->reloc_table = arena_alloc(&file_arena, seg->reloc_count * sizeof(struct reloc));
+            seg->reloc_map = calloc(seg->length, sizeof(word));
 
             for (j = 0; j < seg->reloc_count; j++)
                 read_reloc(seg, j, ne);
         } else {
             seg->reloc_count = 0;
             seg->reloc_table = NULL;
+            seg->reloc_map = NULL;
         }
     }
 
-    /* Second pass: scan entry points (we have to do this after we read
-     * relocation data for all segments.) */
-    for (i = 0; i < ne->entcount; i++) {
-
-        /* don't scan exported values */
-        if (ne->enttab[i].segment == 0 ||
-            ne->enttab[i].segment == 0xfe) continue;
-
-        /* or values that live in data segments */
-        if (ne->segments[ne->enttab[i].segment-1].flags & 0x0001) continue;
-
-        /* Annoyingly, data can be put in code segments, and without any
-         * apparent indication that it is not code. As a dumb heuristic,
-         * only scan exported entries—this won't work universally, and it
-         * may potentially miss private entries, but it's better than nothing. */
-        if (!(ne->enttab[i].flags & 1)) continue;
+    if (!cache_enabled()) {
+        scan_entry_points(ne);
+        return;
+    }
 
-        scan_segment(ne->enttab[i].segment, ne->enttab[i].offset, ne);
-        ne->segments[ne->enttab[i].segment-1].instr_flags[ne->enttab[i].offset] |= INSTR_FUNC;
+    arrays = arena_alloc(&file_arena, count * sizeof(*arrays));
+    for (i = 0; i < count; i++) {
+        arrays[i].data = ne->segments[i].instr_flags;
+        arrays[i].size = ne->segments[i].min_alloc;
     }
 
-    /* and don't forget to scan the program entry point */
-    if (entry_cs == 0 && entry_ip == 0) {
-        /* do nothing */
-    } else if (entry_ip >= ne->segments[entry_cs-1].length) {
-        /* see note above under relocations */
-        warn("Entry point %d:%04x exceeds segment length (%04x)\n", entry_cs, entry_ip, ne->segments[entry_cs-1].length);
-    } else {
-        ne->segments[entry_cs-1].instr_flags[entry_ip] |= INSTR_FUNC;
-        scan_segment(entry_cs, entry_ip, ne);
+    /* The cached flags include the relocations we just marked. */
+    if (!cache_load(&key, arrays, count)) {
+        scan_entry_points(ne);
+        cache_store(&key, arrays, count);
     }
 }
 
@@ -555,23 +608,40 @@ void free_segments(struct ne *ne) {
 
     for (cs = 1; cs <= ne->header.ne_cseg; cs++) {
         seg = &ne->segments[cs-1];
-        free_reloc(seg->reloc_table, seg->reloc_count);
+        free(seg->reloc_map);
         free(seg->instr_flags);
     }
-
-    free(ne->segments);
 }
 
 void print_segments(struct ne *ne) {
     unsigned cs;
     struct segment *seg;
 
+    map_set_phase(MAP_PRINT);
+
     /* Final pass: print data */
     for (cs = 1; cs <= ne->header.ne_cseg; cs++) {
         seg = &ne->segments[cs-1];
 
-        putchar('\n');
-        printf("Segment %d (start = 0x%lx, length = 0x%x, minimum allocation = 0x%x):\n",
+        if (output_format != FORMAT_TEXT) {
+            /* Only code is printed as records, so that's all there is. */
+            index_section(NULL, 0, cs, 0);
+            record_begin("segment");
+            record_uint("number", cs);
+            record_uint("offset", seg->start);
+            record_uint("length", seg->length);
+            record_uint("min_alloc", seg->min_alloc ? seg->min_alloc : 65536);
+            record_uint("flags", seg->flags);
+            record_end();
+            if (!(seg->flags & 0x0001))
+                print_disassembly(seg, ne);
+            map_release(seg->start, seg->length);
+            continue;
+        }
+
+        putc('\n', out);
+        index_section(NULL, 0, cs, 0);
+        fprintf(out, "Segment %d (start = 0x%lx, length = 0x%x, minimum allocation = 0x%x):\n",
             cs, seg->start, seg->length, seg->min_alloc ? seg->min_alloc : 65536);
         print_segment_flags(seg->flags);
 
@@ -585,5 +655,7 @@ void print_segments(struct ne *ne) {
                 print_data(seg);
             print_disassembly(seg, ne);
         }
+
+        map_release(seg->start, seg->length);
     }
 }
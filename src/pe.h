@@ -143,6 +143,7 @@ struct import_module {
 struct pe {
     word magic; /* same as opt->Magic field, but avoids casting */
     qword imagebase; /* same as opt->ImageBase field, but simpler */
+    int rel_addr; /* whether to print addresses relative to the image base */
 
     const struct file_header *header;
     union {
@@ -150,6 +151,7 @@ struct pe {
         const struct optional_header_pep *opt64;
     };
     const struct directory *dirs;
+    unsigned dir_count;
 
     const char *name;
 
@@ -165,6 +167,10 @@ struct pe {
     unsigned reloc_count;
 };
 
+/* in pe_header.c */
+extern const char *pe_symbol_name(const char *name);
+/* in pe_resource.c */
+extern void print_pe_version_info(const struct pe *pe);
 /* in pe_section.c */
 extern struct section *addr2section(dword addr, const struct pe *pe);
 extern off_t addr2offset(dword addr, const struct pe *pe);
@@ -24,7 +24,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include "semblance.h"
+#include "demangle.h"
+#include "imphash.h"
+#include "record.h"
 #include "pe.h"
+#include "sha256.h"
 
 static void print_flags(word flags) {
     char buffer[1024] = "";
@@ -46,7 +50,7 @@ static void print_flags(word flags) {
     if (flags & 0x4000) strcat(buffer, ", uniprocessor");
     if (flags & 0x8000) strcat(buffer, ", big-endian");
 
-    printf("Flags: 0x%04x (%s)\n", flags, buffer+2);
+    fprintf(out, "Flags: 0x%04x (%s)\n", flags, buffer+2);
 }
 
 static void print_dll_flags(word flags) {
@@ -66,7 +70,7 @@ static void print_dll_flags(word flags) {
     if (flags & 0x8000) strcat(buffer, ", terminal server aware");
     if (flags & 0x5030) sprintf(buffer+strlen(buffer), ", (unknown flags 0x%04x)", flags & 0x5030);
 
-    printf("DLL flags: 0x%04x (%s)\n", flags, buffer+2);
+    fprintf(out, "DLL flags: 0x%04x (%s)\n", flags, buffer+2);
 }
 
 static const char *const subsystems[] = {
@@ -90,88 +94,159 @@ static const char *const subsystems[] = {
     0
 };
 
-static void print_opt32(const struct optional_header *opt)
+static void print_opt32(const struct pe *pe)
 {
-    printf("File version: %d.%d\n", opt->MajorImageVersion, opt->MinorImageVersion); /* 44 */
+    const struct optional_header *opt = pe->opt32;
 
-    printf("Linker version: %d.%d\n", opt->MajorLinkerVersion, opt->MinorLinkerVersion); /* 1a */
+    fprintf(out, "File version: %d.%d\n", opt->MajorImageVersion, opt->MinorImageVersion); /* 44 */
+
+    fprintf(out, "Linker version: %d.%d\n", opt->MajorLinkerVersion, opt->MinorLinkerVersion); /* 1a */
 
     if (opt->AddressOfEntryPoint) {
         dword address = opt->AddressOfEntryPoint;
-        if (!pe_rel_addr)
+        if (!pe->rel_addr)
             address += opt->ImageBase;
-        printf("Program entry point: 0x%x\n", address); /* 28 */
+        fprintf(out, "Program entry point: 0x%x\n", address); /* 28 */
     }
 
-    printf("Base of code section: 0x%x\n", opt->BaseOfCode); /* 2c */
-    printf("Base of data section: 0x%x\n", opt->BaseOfData); /* 30 */
+    fprintf(out, "Base of code section: 0x%x\n", opt->BaseOfCode); /* 2c */
+    fprintf(out, "Base of data section: 0x%x\n", opt->BaseOfData); /* 30 */
 
-    printf("Preferred base address: 0x%x\n", opt->ImageBase); /* 34 */
-    printf("Required OS version: %d.%d\n", opt->MajorOperatingSystemVersion, opt->MinorOperatingSystemVersion); /* 40 */
+    fprintf(out, "Preferred base address: 0x%x\n", opt->ImageBase); /* 34 */
+    fprintf(out, "Required OS version: %d.%d\n", opt->MajorOperatingSystemVersion, opt->MinorOperatingSystemVersion); /* 40 */
 
     if (opt->Win32VersionValue != 0)
         warn("Win32VersionValue is %d (expected 0)\n", opt->Win32VersionValue); /* 4c */
 
     if (opt->Subsystem <= 16) /* 5c */
-        printf("Subsystem: %s\n", subsystems[opt->Subsystem]);
+        fprintf(out, "Subsystem: %s\n", subsystems[opt->Subsystem]);
     else
-        printf("Subsystem: (unknown value %d)\n", opt->Subsystem);
-    printf("Subsystem version: %d.%d\n", opt->MajorSubsystemVersion, opt->MinorSubsystemVersion); /* 48 */
+        fprintf(out, "Subsystem: (unknown value %d)\n", opt->Subsystem);
+    fprintf(out, "Subsystem version: %d.%d\n", opt->MajorSubsystemVersion, opt->MinorSubsystemVersion); /* 48 */
 
     print_dll_flags(opt->DllCharacteristics); /* 5e */
 
-    printf("Stack size (reserve): %d bytes\n", opt->SizeOfStackReserve); /* 60 */
-    printf("Stack size (commit): %d bytes\n", opt->SizeOfStackCommit); /* 64 */
-    printf("Heap size (reserve): %d bytes\n", opt->SizeOfHeapReserve); /* 68 */
-    printf("Heap size (commit): %d bytes\n", opt->SizeOfHeapCommit); /* 6c */
+    fprintf(out, "Stack size (reserve): %d bytes\n", opt->SizeOfStackReserve); /* 60 */
+    fprintf(out, "Stack size (commit): %d bytes\n", opt->SizeOfStackCommit); /* 64 */
+    fprintf(out, "Heap size (reserve): %d bytes\n", opt->SizeOfHeapReserve); /* 68 */
+    fprintf(out, "Heap size (commit): %d bytes\n", opt->SizeOfHeapCommit); /* 6c */
 
     if (opt->LoaderFlags != 0)
         warn("LoaderFlags is 0x%x (expected 0)\n", opt->LoaderFlags); /* 70 */
 }
 
-static void print_opt64(const struct optional_header_pep *opt)
+static void print_opt64(const struct pe *pe)
 {
-    printf("File version: %d.%d\n", opt->MajorImageVersion, opt->MinorImageVersion); /* 44 */
+    const struct optional_header_pep *opt = pe->opt64;
+
+    fprintf(out, "File version: %d.%d\n", opt->MajorImageVersion, opt->MinorImageVersion); /* 44 */
 
-    printf("Linker version: %d.%d\n", opt->MajorLinkerVersion, opt->MinorLinkerVersion); /* 1a */
+    fprintf(out, "Linker version: %d.%d\n", opt->MajorLinkerVersion, opt->MinorLinkerVersion); /* 1a */
 
     if (opt->AddressOfEntryPoint) {
         dword address = opt->AddressOfEntryPoint;
-        if (!pe_rel_addr)
+        if (!pe->rel_addr)
             address += opt->ImageBase;
-        printf("Program entry point: 0x%x\n", address); /* 28 */
+        fprintf(out, "Program entry point: 0x%x\n", address); /* 28 */
     }
 
-    printf("Base of code section: 0x%x\n", opt->BaseOfCode); /* 2c */
+    fprintf(out, "Base of code section: 0x%x\n", opt->BaseOfCode); /* 2c */
 
-    printf("Preferred base address: 0x%lx\n", opt->ImageBase); /* 30 */
-    printf("Required OS version: %d.%d\n", opt->MajorOperatingSystemVersion, opt->MinorOperatingSystemVersion); /* 40 */
+    fprintf(out, "Preferred base address: 0x%lx\n", opt->ImageBase); /* 30 */
+    fprintf(out, "Required OS version: %d.%d\n", opt->MajorOperatingSystemVersion, opt->MinorOperatingSystemVersion); /* 40 */
 
     if (opt->Win32VersionValue != 0)
         warn("Win32VersionValue is %d (expected 0)\n", opt->Win32VersionValue); /* 4c */
 
     if (opt->Subsystem <= 16) /* 5c */
-        printf("Subsystem: %s\n", subsystems[opt->Subsystem]);
+        fprintf(out, "Subsystem: %s\n", subsystems[opt->Subsystem]);
     else
-        printf("Subsystem: (unknown value %d)\n", opt->Subsystem);
-    printf("Subsystem version: %d.%d\n", opt->MajorSubsystemVersion, opt->MinorSubsystemVersion); /* 48 */
+        fprintf(out, "Subsystem: (unknown value %d)\n", opt->Subsystem);
+    fprintf(out, "Subsystem version: %d.%d\n", opt->MajorSubsystemVersion, opt->MinorSubsystemVersion); /* 48 */
 
     print_dll_flags(opt->DllCharacteristics); /* 5e */
 
-    printf("Stack size (reserve): %ld bytes\n", opt->SizeOfStackReserve); /* 60 */
-    printf("Stack size (commit): %ld bytes\n", opt->SizeOfStackCommit); /* 68 */
-    printf("Heap size (reserve): %ld bytes\n", opt->SizeOfHeapReserve); /* 70 */
-    printf("Heap size (commit): %ld bytes\n", opt->SizeOfHeapCommit); /* 78 */
+    fprintf(out, "Stack size (reserve): %ld bytes\n", opt->SizeOfStackReserve); /* 60 */
+    fprintf(out, "Stack size (commit): %ld bytes\n", opt->SizeOfStackCommit); /* 68 */
+    fprintf(out, "Heap size (reserve): %ld bytes\n", opt->SizeOfHeapReserve); /* 70 */
+    fprintf(out, "Heap size (commit): %ld bytes\n", opt->SizeOfHeapCommit); /* 78 */
 
     if (opt->LoaderFlags != 0)
         warn("LoaderFlags is 0x%x (expected 0)\n", opt->LoaderFlags); /* 80 */
 }
 
+static void print_version_field(const char *key, word major, word minor)
+{
+    char buffer[12];
+
+    sprintf(buffer, "%u.%u", major, minor);
+    record_string(key, buffer);
+}
+
+/* The same as print_header(), as two records: one for the file header and one
+ * for the optional header. */
+static void print_header_records(const struct pe *pe)
+{
+    const struct optional_header *opt = pe->opt32;
+    const struct optional_header_pep *opt64 = pe->opt64;
+
+    record_begin("header");
+    record_string("group", "file");
+    record_uint("machine", pe->header->Machine);
+    record_uint("sections", pe->header->NumberOfSections);
+    record_uint("timestamp", pe->header->TimeDateStamp);
+    record_uint("flags", pe->header->Characteristics);
+    record_end();
+
+    if (!pe->header->SizeOfOptionalHeader || (pe->magic != 0x10b && pe->magic != 0x20b))
+        return;
+
+    /* Most fields are at the same offset in both. */
+    record_begin("header");
+    record_string("group", "optional");
+    record_uint("bits", pe->magic == 0x10b ? 32 : 64);
+    print_version_field("file_version", opt->MajorImageVersion, opt->MinorImageVersion);
+    print_version_field("linker_version", opt->MajorLinkerVersion, opt->MinorLinkerVersion);
+    if (opt->AddressOfEntryPoint)
+        record_uint("entry_point", opt->AddressOfEntryPoint + (pe->rel_addr ? 0 : pe->imagebase));
+    record_uint("code_base", opt->BaseOfCode);
+    if (pe->magic == 0x10b)
+        record_uint("data_base", opt->BaseOfData);
+    record_uint("image_base", pe->imagebase);
+    print_version_field("os_version", opt->MajorOperatingSystemVersion, opt->MinorOperatingSystemVersion);
+    if (opt->Subsystem <= 16)
+        record_string("subsystem", subsystems[opt->Subsystem]);
+    else
+        record_uint("subsystem", opt->Subsystem);
+    print_version_field("subsystem_version", opt->MajorSubsystemVersion, opt->MinorSubsystemVersion);
+    record_uint("dll_flags", opt->DllCharacteristics);
+    if (pe->magic == 0x10b)
+    {
+        record_uint("stack_reserve", opt->SizeOfStackReserve);
+        record_uint("stack_commit", opt->SizeOfStackCommit);
+        record_uint("heap_reserve", opt->SizeOfHeapReserve);
+        record_uint("heap_commit", opt->SizeOfHeapCommit);
+    }
+    else
+    {
+        record_uint("stack_reserve", opt64->SizeOfStackReserve);
+        record_uint("stack_commit", opt64->SizeOfStackCommit);
+        record_uint("heap_reserve", opt64->SizeOfHeapReserve);
+        record_uint("heap_commit", opt64->SizeOfHeapCommit);
+    }
+    record_end();
+}
+
 static void print_header(struct pe *pe) {
-    putchar('\n');
+    if (output_format != FORMAT_TEXT) {
+        print_header_records(pe);
+        return;
+    }
+
+    putc('\n', out);
 
     if (!pe->header->SizeOfOptionalHeader) {
-        printf("No optional header\n");
+        fprintf(out, "No optional header\n");
         return;
     } else if (pe->header->SizeOfOptionalHeader < sizeof(struct optional_header))
         warn("Size of optional header is %u (expected at least %lu).\n",
@@ -180,12 +255,111 @@ static void print_header(struct pe *pe) {
     print_flags(pe->header->Characteristics); /* 16 */
 
     if (pe->magic == 0x10b) {
-        printf("Image type: 32-bit\n");
-        print_opt32(pe->opt32);
+        fprintf(out, "Image type: 32-bit\n");
+        print_opt32(pe);
     } else if (pe->magic == 0x20b) {
-        printf("Image type: 64-bit\n");
-        print_opt64(pe->opt64);
+        fprintf(out, "Image type: 64-bit\n");
+        print_opt64(pe);
+    }
+}
+
+static void print_checksum(struct pe *pe)
+{
+    /* CheckSum is at the same offset for both 32- and 64-bit images. */
+    dword stored = pe->opt32->CheckSum;
+    dword sum = pe_checksum((const byte *)&pe->opt32->CheckSum - map);
+
+    if (output_format != FORMAT_TEXT)
+    {
+        record_begin("checksum");
+        record_uint("stored", stored);
+        record_uint("computed", sum);
+        record_end();
+    }
+    else if (!stored)
+        fprintf(out, "Checksum: not set (computed %08x)\n", sum);
+    else if (stored == sum)
+        fprintf(out, "Checksum: %08x (valid)\n", sum);
+    else
+        fprintf(out, "Checksum: %08x (mismatch, computed %08x)\n", stored, sum);
+}
+
+/* Print the digest that Authenticode signs. This covers the whole file except
+ * for the checksum, the security directory entry, and the certificate table
+ * itself (which is given by file offset rather than RVA, and must come last).
+ * Those split the file into at most three ranges, which we hash in place. */
+static void print_image_hash(struct pe *pe)
+{
+    off_t checksum = (const byte *)&pe->opt32->CheckSum - map;
+    off_t secdir = (const byte *)&pe->dirs[4] - map;
+    dword cdirs = (pe->magic == 0x10b) ? pe->opt32->NumberOfRvaAndSizes : pe->opt64->NumberOfRvaAndSizes;
+    off_t end = map_size;
+    byte digest[SHA256_DIGEST_SIZE];
+    struct sha256 ctx;
+    int i;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, read_data(0), checksum);
+    if (cdirs > 4)
+    {
+        if (pe->dirs[4].size && pe->dirs[4].address >= secdir + sizeof(struct directory)
+                && pe->dirs[4].address <= map_size)
+            end = pe->dirs[4].address;
+        else if (pe->dirs[4].size)
+            warn("Certificate table at %#x is outside of the file.\n", pe->dirs[4].address);
+
+        sha256_update(&ctx, read_data(checksum + 4), secdir - (checksum + 4));
+        sha256_update(&ctx, read_data(secdir + sizeof(struct directory)),
+                end - (secdir + sizeof(struct directory)));
+    }
+    else
+        sha256_update(&ctx, read_data(checksum + 4), end - (checksum + 4));
+    sha256_final(&ctx, digest);
+
+    if (output_format != FORMAT_TEXT)
+    {
+        record_begin("image_hash");
+        record_bytes("sha256", digest, sizeof(digest));
+        record_end();
+        return;
     }
+
+    fprintf(out, "Image hash (SHA-256): ");
+    for (i = 0; i < sizeof(digest); i++)
+        fprintf(out, "%02x", digest[i]);
+    putc('\n', out);
+}
+
+static void print_pe_import_hash(const struct pe *pe)
+{
+    struct import_set set = {0};
+    byte digest[SHA256_DIGEST_SIZE];
+    unsigned i, j;
+
+    for (i = 0; i < pe->import_count; i++)
+    {
+        const struct import_module *module = &pe->imports[i];
+
+        import_set_add(&set, module->module, NULL, -1);
+        for (j = 0; j < module->count; j++)
+        {
+            if (module->nametab[j].is_ordinal)
+                import_set_add(&set, module->module, NULL, module->nametab[j].ordinal);
+            else
+                import_set_add(&set, module->module, module->nametab[j].name, -1);
+        }
+    }
+
+    import_set_hash(&set, digest);
+    print_import_hash(digest);
+}
+
+/* Names of exports and imports, as they should be displayed. */
+const char *pe_symbol_name(const char *name)
+{
+    if (opts & DEMANGLE)
+        return demangle(name, 1);
+    return name;
 }
 
 static void print_specfile(struct pe *pe) {
@@ -225,27 +399,45 @@ struct export_header {
 
 STATIC_ASSERT(sizeof(struct export_header) == 0x28);
 
+/* A table of count entries of the given size at the given offset had better
+ * fit in the file. */
+static dword clamp_table_count(off_t offset, dword count, size_t size, const char *what)
+{
+    if (offset >= map_size)
+        return 0;
+    if (count > (map_size - offset) / size)
+    {
+        warn("%s table at %#lx has too many entries (%u).\n", what, offset, count);
+        return (map_size - offset) / size;
+    }
+    return count;
+}
+
 static void get_export_table(struct pe *pe)
 {
     const struct export_header *header;
     off_t offset;
+    dword addr_count, name_count;
     int i;
 
     /* More headers. It's like a PE file is nothing but headers.
      * Do we really need to print any of this? No, not really. Just use the data. */
     header = read_data(addr2offset(pe->dirs[0].address, pe));
     offset = addr2offset(header->addr_table_addr, pe);
+    addr_count = clamp_table_count(offset, header->addr_table_count, sizeof(dword), "Export address");
+    name_count = clamp_table_count(addr2offset(header->name_table_addr, pe),
+                                   header->export_count, sizeof(dword), "Export name");
 
     /* Grab the name. */
     pe->name = read_data(addr2offset(header->module_name_addr, pe));
 
     /* Grab the exports. */
-    pe->exports = malloc(header->addr_table_count * sizeof(struct export));
+    pe->exports = arena_alloc(&file_arena, addr_count * sizeof(struct export));
 
     /* If addr_table_count exceeds export_count, this means that some exports
      * are nameless (and thus exported by ordinal). */
 
-    for (i = 0; i < header->addr_table_count; ++i)
+    for (i = 0; i < addr_count; ++i)
     {
         pe->exports[i].ordinal = i + header->ordinal_base;
         pe->exports[i].address = read_dword(offset + i * 4);
@@ -253,14 +445,18 @@ static void get_export_table(struct pe *pe)
     }
 
     /* Why? WHY? */
-    for (i = 0; i < header->export_count; ++i)
+    for (i = 0; i < name_count; ++i)
     {
         word index = read_word(addr2offset(header->ord_table_addr, pe) + (i * sizeof(word)));
         dword name_addr = read_dword(addr2offset(header->name_table_addr, pe) + (i * sizeof(dword)));
+        if (index >= addr_count) {
+            warn("Export name %u has invalid index %u.\n", i, index);
+            continue;
+        }
         pe->exports[index].name = read_data(addr2offset(name_addr, pe));
     }
 
-    pe->export_count = header->addr_table_count;
+    pe->export_count = addr_count;
 }
 
 static void get_import_name_table(struct import_module *module, dword nametab_addr, struct pe *pe)
@@ -274,7 +470,7 @@ static void get_import_name_table(struct import_module *module, dword nametab_ad
     else
         while (read_qword(offset + count * 8)) count++;
 
-    module->nametab = malloc(count * sizeof(*module->nametab));
+    module->nametab = arena_alloc(&file_arena, count * sizeof(*module->nametab));
 
     for (i = 0; i < count; i++) {
         qword address;
@@ -305,7 +501,7 @@ static void get_import_module_table(struct pe *pe) {
     while (memcmp(read_data(offset + pe->import_count * 20), zeroes, 20))
         pe->import_count++;
 
-    pe->imports = malloc(pe->import_count * sizeof(struct import_module));
+    pe->imports = arena_alloc(&file_arena, pe->import_count * sizeof(struct import_module));
 
     for (i = 0; i < pe->import_count; i++)
     {
@@ -315,24 +511,40 @@ static void get_import_module_table(struct pe *pe) {
     }
 }
 
+/* Relocations come in blocks, each with its own size. Stop at the first one
+ * which doesn't make sense, rather than walking off into the weeds. */
+static dword get_reloc_block_size(off_t cursor, off_t end)
+{
+    dword block_size = read_dword(cursor + 4);
+
+    if (block_size < 8 || block_size > end - cursor || map_error)
+    {
+        warn("Relocation block at %#lx has invalid size %#x.\n", cursor, block_size);
+        return 0;
+    }
+    return block_size;
+}
+
 static void get_reloc_table(struct pe *pe) {
     off_t offset = addr2offset(pe->dirs[5].address, pe), cursor = offset;
+    off_t end = offset + pe->dirs[5].size;
     unsigned i, reloc_idx = 0;
+    dword block_size;
 
     pe->reloc_count = 0;
-    while (cursor < offset + pe->dirs[5].size)
+    while (cursor < end && (block_size = get_reloc_block_size(cursor, end)))
     {
-        pe->reloc_count += (read_dword(cursor + 4) - 8) / 2;
-        cursor += read_dword(cursor + 4);
+        pe->reloc_count += (block_size - 8) / 2;
+        cursor += block_size;
     }
 
-    pe->relocs = malloc(pe->reloc_count * sizeof(*pe->relocs));
+    pe->relocs = arena_alloc(&file_arena, pe->reloc_count * sizeof(*pe->relocs));
     cursor = offset;
-    while (cursor < offset + pe->dirs[5].size)
+    while (reloc_idx < pe->reloc_count)
     {
         dword block_base = read_dword(cursor);
-        dword block_size = read_dword(cursor + 4);
 
+        block_size = read_dword(cursor + 4);
         for (i = 0; i < (block_size - 8) / 2; ++i)
         {
             word r = read_word(cursor + 8 + i * 2);
@@ -344,7 +556,8 @@ static void get_reloc_table(struct pe *pe) {
     }
 }
 
-static void readpe(off_t offset_pe, struct pe *pe)
+/* Returns 0 if the image is of a type we can't read. */
+static int readpe(off_t offset_pe, struct pe *pe)
 {
     off_t offset;
     int i, cdirs;
@@ -364,22 +577,31 @@ static void readpe(off_t offset_pe, struct pe *pe)
         offset = offset_pe + 4 + sizeof(struct file_header) + sizeof(struct optional_header_pep);
     } else {
         warn("Don't know how to read image type %#x\n", pe->magic);
-        exit(1);
+        map_error = 1;
+        return 0;
     }
 
     pe->dirs = read_data(offset);
+    pe->dir_count = cdirs;
     offset += cdirs * sizeof(struct directory);
 
     /* read the section table */
-    pe->sections = malloc(pe->header->NumberOfSections * sizeof(struct section));
+    pe->sections = arena_alloc(&file_arena, pe->header->NumberOfSections * sizeof(struct section));
     for (i = 0; i < pe->header->NumberOfSections; i++)
     {
         memcpy(&pe->sections[i], read_data(offset + i*0x28), 0x28);
 
+        /* Don't walk off the end of a truncated file. */
+        if (pe->sections[i].length > map_size - min(pe->sections[i].offset, map_size))
+        {
+            warn("Section %.8s extends past the end of the file.\n", pe->sections[i].name);
+            pe->sections[i].length = map_size - min(pe->sections[i].offset, map_size);
+        }
+
         /* allocate zeroes, but only if it's a code section */
         /* in theory nobody will ever try to jump into a data section.
          * VirtualProtect() be damned */
-        if (pe->sections[i].flags & 0x20)
+        if ((mode & DISASSEMBLE) && (pe->sections[i].flags & 0x20))
             pe->sections[i].instr_flags = calloc(pe->sections[i].min_alloc, sizeof(byte));
         else
             pe->sections[i].instr_flags = NULL;
@@ -390,6 +612,10 @@ static void readpe(off_t offset_pe, struct pe *pe)
      * them in separate "directories". But the order of these seems to be fixed
      * anyway, so why bother? */
 
+    /* --version-info only needs the sections, to find the resource table. */
+    if (mode == VERSIONINFO)
+        return 1;
+
     if (cdirs >= 1 && pe->dirs[0].size)
         get_export_table(pe);
     if (cdirs >= 2 && pe->dirs[1].size)
@@ -400,6 +626,7 @@ static void readpe(off_t offset_pe, struct pe *pe)
     /* Read the code. */
     if (mode & DISASSEMBLE)
         read_sections(pe);
+    return 1;
 }
 
 static void freepe(struct pe *pe) {
@@ -407,19 +634,56 @@ static void freepe(struct pe *pe) {
 
     for (i = 0; i < pe->header->NumberOfSections; i++)
         free(pe->sections[i].instr_flags);
-    free(pe->sections);
-    free(pe->exports);
+    arena_free(&file_arena);
+}
+
+static void print_export_records(const struct pe *pe)
+{
+    unsigned i;
+
+    for (i = 0; i < pe->export_count; i++)
+    {
+        dword address = pe->exports[i].address;
+        if (!address)
+            continue;
+        record_begin("export");
+        record_uint("ordinal", pe->exports[i].ordinal);
+        record_address("address", address + (pe->rel_addr ? 0 : pe->imagebase));
+        if (pe->exports[i].name)
+            record_string("name", pe_symbol_name(pe->exports[i].name));
+        if (address >= pe->dirs[0].address && address < (pe->dirs[0].address + pe->dirs[0].size))
+            record_string("forward", read_data(addr2offset(address, pe)));
+        record_end();
+    }
+}
+
+static void print_import_records(const struct pe *pe)
+{
+    unsigned i, j;
+
     for (i = 0; i < pe->import_count; i++)
-        free(pe->imports[i].nametab);
-    free(pe->relocs);
-    free(pe->imports);
+    {
+        for (j = 0; j < pe->imports[i].count; j++)
+        {
+            record_begin("import");
+            record_string("module", pe->imports[i].module);
+            if (pe->imports[i].nametab[j].is_ordinal)
+                record_uint("ordinal", pe->imports[i].nametab[j].ordinal);
+            else
+                record_string("name", pe_symbol_name(pe->imports[i].nametab[j].name));
+            record_end();
+        }
+    }
 }
 
 void dumppe(off_t offset_pe) {
     struct pe pe = {0};
     int i, j;
 
-    readpe(offset_pe, &pe);
+    if (!readpe(offset_pe, &pe)) {
+        arena_free(&file_arena);
+        return;
+    }
 
     if (mode == SPECFILE) {
         print_specfile(&pe);
@@ -427,6 +691,18 @@ void dumppe(off_t offset_pe) {
         return;
     }
 
+    if (mode == CLUSTER) {
+        print_pe_import_hash(&pe);
+        freepe(&pe);
+        return;
+    }
+
+    if (mode == VERSIONINFO) {
+        print_pe_version_info(&pe);
+        freepe(&pe);
+        return;
+    }
+
     /* objdump always applies the image base to addresses. This makes sense for
      * EXEs, which can always be loaded at their preferred address, but for DLLs
      * it just makes debugging more annoying, since you have to subtract the
@@ -443,56 +719,79 @@ void dumppe(off_t offset_pe) {
      * Internally we want to use relative IPs everywhere possible. The only place
      * that we can't is in arg->value. */
     if (pe_rel_addr == -1)
-        pe_rel_addr = pe.header->Characteristics & 0x2000;
+        pe.rel_addr = pe.header->Characteristics & 0x2000;
+    else
+        pe.rel_addr = pe_rel_addr;
+
+    if (output_format != FORMAT_TEXT) {
+        record_begin("module");
+        record_string("file", file_name);
+        record_string("format", "PE");
+        if (pe.name) record_string("name", pe.name);
+        record_end();
+    } else {
+        fprintf(out, "Module type: PE (Portable Executable)\n");
+        if (pe.name) fprintf(out, "Module name: %s\n", pe.name);
+    }
+
+    if ((mode & VERIFYSUM) && pe.header->SizeOfOptionalHeader)
+        print_checksum(&pe);
+
+    if ((mode & IMAGEHASH) && pe.header->SizeOfOptionalHeader)
+        print_image_hash(&pe);
 
-    printf("Module type: PE (Portable Executable)\n");
-    if (pe.name) printf("Module name: %s\n", pe.name);
+    if (mode & IMPORTHASH)
+        print_pe_import_hash(&pe);
 
     if (mode & DUMPHEADER)
         print_header(&pe);
 
-    if (mode & DUMPEXPORT) {
-        putchar('\n');
+    if ((mode & DUMPEXPORT) && output_format != FORMAT_TEXT)
+        print_export_records(&pe);
+    else if (mode & DUMPEXPORT) {
+        putc('\n', out);
         if (pe.exports) {
-            printf("Exports:\n");
+            fprintf(out, "Exports:\n");
 
             for (i = 0; i < pe.export_count; i++) {
                 dword address = pe.exports[i].address;
                 if (!address)
                     continue;
-                if (!pe_rel_addr)
+                if (!pe.rel_addr)
                     address += pe.imagebase;
-                printf("\t%5d\t%#8x\t%s", pe.exports[i].ordinal, address,
-                    pe.exports[i].name ? pe.exports[i].name : "<no name>");
+                fprintf(out, "\t%5d\t%#8x\t%s", pe.exports[i].ordinal, address,
+                    pe.exports[i].name ? pe_symbol_name(pe.exports[i].name) : "<no name>");
                 if (pe.exports[i].address >= pe.dirs[0].address
                         && pe.exports[i].address < (pe.dirs[0].address + pe.dirs[0].size))
-                    printf(" -> %s", (const char *)read_data(addr2offset(pe.exports[i].address, &pe)));
-                putchar('\n');
+                    fprintf(out, " -> %s", (const char *)read_data(addr2offset(pe.exports[i].address, &pe)));
+                putc('\n', out);
             }
         } else
-            printf("No export table\n");
+            fprintf(out, "No export table\n");
     }
 
-    if (mode & DUMPIMPORT) {
-        putchar('\n');
+    if ((mode & DUMPIMPORT) && output_format != FORMAT_TEXT)
+        print_import_records(&pe);
+    else if (mode & DUMPIMPORT) {
+        putc('\n', out);
         if (pe.imports) {
-            printf("Imported modules:\n");
+            fprintf(out, "Imported modules:\n");
             for (i = 0; i < pe.import_count; i++)
-                printf("\t%s\n", pe.imports[i].module);
+                fprintf(out, "\t%s\n", pe.imports[i].module);
 
-            printf("\nImported functions:\n");
+            fprintf(out, "\nImported functions:\n");
             for (i = 0; i < pe.import_count; i++) {
-                printf("\t%s:\n", pe.imports[i].module);
+                fprintf(out, "\t%s:\n", pe.imports[i].module);
                 for (j = 0; j < pe.imports[i].count; j++)
                 {
                     if (pe.imports[i].nametab[j].is_ordinal)
-                        printf("\t\t<ordinal %u>\n", pe.imports[i].nametab[j].ordinal);
+                        fprintf(out, "\t\t<ordinal %u>\n", pe.imports[i].nametab[j].ordinal);
                     else
-                        printf("\t\t%s\n", pe.imports[i].nametab[j].name);
+                        fprintf(out, "\t\t%s\n", pe_symbol_name(pe.imports[i].nametab[j].name));
                 }
             }
         } else
-            printf("No imported module table\n");
+            fprintf(out, "No imported module table\n");
     }
 
     if (mode & DISASSEMBLE)
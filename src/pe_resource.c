@@ -0,0 +1,100 @@
+/*
+ * Functions for parsing PE resources
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "semblance.h"
+#include "pe.h"
+
+struct resource_directory {
+    dword Characteristics;
+    dword TimeDateStamp;
+    word  MajorVersion;
+    word  MinorVersion;
+    word  NumberOfNamedEntries;
+    word  NumberOfIdEntries;
+};
+
+struct resource_entry {
+    dword name;     /* string offset if the high bit is set, otherwise an ID */
+    dword offset;   /* subdirectory offset if the high bit is set */
+};
+
+struct resource_data {
+    dword address;
+    dword size;
+    dword codepage;
+    dword reserved;
+};
+
+/* Find an entry in the directory at the given offset (relative to the start of
+ * the resource section). If id is negative, take the first entry. Returns the
+ * entry's offset, or 0 if there is none. */
+static dword find_resource_entry(off_t base, off_t end, dword offset, int id)
+{
+    const struct resource_directory *dir;
+    const struct resource_entry *entries;
+    unsigned i, count;
+
+    if (base + offset + sizeof(*dir) > end)
+        return 0;
+    dir = read_data(base + offset);
+    entries = (const struct resource_entry *)(dir + 1);
+    count = dir->NumberOfNamedEntries + dir->NumberOfIdEntries;
+
+    if (base + offset + sizeof(*dir) + count * sizeof(*entries) > end)
+        return 0;
+
+    /* Named entries come first; IDs are sorted after them. */
+    for (i = (id < 0 ? 0 : dir->NumberOfNamedEntries); i < count; i++)
+    {
+        if (id < 0 || entries[i].name == id)
+            return entries[i].offset;
+    }
+    return 0;
+}
+
+/* For --version-info we walk straight down to the first RT_VERSION resource,
+ * without reading anything else. */
+void print_pe_version_info(const struct pe *pe)
+{
+    const struct resource_data *data;
+    off_t base, end;
+    dword entry;
+
+    if (pe->dir_count < 3 || !pe->dirs[2].size
+            || !(base = addr2offset(pe->dirs[2].address, pe))) {
+        print_no_version_record();
+        return;
+    }
+    end = min(base + pe->dirs[2].size, map_size);
+
+    /* type, then name, then language */
+    if (!(entry = find_resource_entry(base, end, 0, 16)) || !(entry & 0x80000000)
+            || !(entry = find_resource_entry(base, end, entry & 0x7fffffff, -1)) || !(entry & 0x80000000)
+            || !(entry = find_resource_entry(base, end, entry & 0x7fffffff, -1)) || (entry & 0x80000000)
+            || base + entry + sizeof(*data) > end) {
+        print_no_version_record();
+        return;
+    }
+
+    data = read_data(base + entry);
+    print_version_record(addr2offset(data->address, pe), data->size, 1);
+}
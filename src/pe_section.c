@@ -21,9 +21,15 @@
  */
 
 #include <ctype.h>
+#include <stddef.h>
 #include <string.h>
 #include "semblance.h"
+#include "cache.h"
+#include "dedup.h"
+#include "index.h"
+#include "record.h"
 #include "pe.h"
+#include "where.h"
 #include "x86_instr.h"
 
 #ifdef USE_WARN
@@ -34,7 +40,7 @@
 #define warn_at(...)
 #endif
 
-int pe_rel_addr = -1;
+__thread int pe_rel_addr = -1;
 
 struct section *addr2section(dword addr, const struct pe *pe) {
     /* Even worse than the below, some data is sensitive to which section it's in! */
@@ -64,13 +70,13 @@ static const char *get_export_name(dword ip, const struct pe *pe) {
     int i;
     for (i = 0; i < pe->export_count; i++) {
         if (pe->exports[i].address == ip)
-            return pe->exports[i].name;
+            return pe->exports[i].name ? pe_symbol_name(pe->exports[i].name) : NULL;
     }
     return NULL;
 }
 
 static const char *get_imported_name(dword offset, const struct pe *pe) {
-    static char comment[256];
+    static __thread char comment[256];
     unsigned i;
 
     for (i = 0; i < pe->import_count; ++i)
@@ -85,7 +91,7 @@ static const char *get_imported_name(dword offset, const struct pe *pe) {
                 sprintf(comment, "%s.%u", module->module, module->nametab[index].ordinal);
                 return comment;
             }
-            return module->nametab[index].name;
+            return pe_symbol_name(module->nametab[index].name);
         }
     }
     return NULL;
@@ -103,7 +109,7 @@ static const struct reloc_pe *get_reloc(dword ip, const struct pe *pe) {
 
 static char *relocate_arg(const struct instr *instr, const struct arg *arg, const struct pe *pe) {
     const struct reloc_pe *r = get_reloc(arg->ip, pe);
-    static char comment[10];
+    static __thread char comment[10];
 
     if (!r)
         return NULL;
@@ -112,7 +118,7 @@ static char *relocate_arg(const struct instr *instr, const struct arg *arg, cons
         return NULL;    /* not even a real relocation, just padding */
     else if (r->type == 3) {
         if (arg->type == IMM || (arg->type == RM && instr->modrm_reg == -1) || arg->type == MOFFS) {
-            snprintf(comment, 10, "%lx", pe_rel_addr ? arg->value - pe->imagebase : arg->value);
+            snprintf(comment, 10, "%lx", pe->rel_addr ? arg->value - pe->imagebase : arg->value);
             return comment;
         }
     }
@@ -120,10 +126,11 @@ static char *relocate_arg(const struct instr *instr, const struct arg *arg, cons
     return NULL;
 }
 
+/* Sets *import if the comment is the name of an imported function. */
 static const char *get_arg_comment(const struct section *sec, dword end_ip,
-        const struct instr *instr, const struct arg *arg, const struct pe *pe)
+        const struct instr *instr, const struct arg *arg, const struct pe *pe, int *import)
 {
-    static char comment_str[10];
+    static __thread char comment_str[10];
     struct section *tsec;
     const char *comment;
     qword rel_value;
@@ -138,14 +145,16 @@ static const char *get_arg_comment(const struct section *sec, dword end_ip,
 
         tip = end_ip + arg->value;
 
-        if ((comment = get_imported_name(tip, pe)))
+        if ((comment = get_imported_name(tip, pe))) {
+            *import = 1;
             return comment;
+        }
 
         if ((comment = get_export_name(tip, pe)))
             return comment;
 
         abstip = tip;
-        if (!pe_rel_addr) abstip += pe->imagebase;
+        if (!pe->rel_addr) abstip += pe->imagebase;
 
         snprintf(comment_str, 10, "%lx", abstip);
         return comment_str;
@@ -160,8 +169,10 @@ static const char *get_arg_comment(const struct section *sec, dword end_ip,
      * has a relocation entry. */
     if ((tsec = addr2section(rel_value, pe)) || (sec->instr_flags[arg->ip - sec->address] & INSTR_RELOC))
     {
-        if ((comment = get_imported_name(rel_value, pe)))
+        if ((comment = get_imported_name(rel_value, pe))) {
+            *import = 1;
             return comment;
+        }
         if ((comment = get_export_name(rel_value, pe)))
             return comment;
 
@@ -172,7 +183,9 @@ static const char *get_arg_comment(const struct section *sec, dword end_ip,
                 && read_word(addr2offset(rel_value, pe)) == 0x25ff) /* absolute jmp */
         {
             rel_value = read_dword(addr2offset(rel_value, pe) + 2) - pe->imagebase;
-            return get_imported_name(rel_value, pe);
+            comment = get_imported_name(rel_value, pe);
+            *import = !!comment;
+            return comment;
         }
 
         if ((comment = relocate_arg(instr, arg, pe)))
@@ -192,35 +205,41 @@ static const char *get_arg_comment(const struct section *sec, dword end_ip,
 
 static int print_pe_instr(const struct section *sec, dword ip, byte *p, const struct pe *pe) {
     struct instr instr = {0};
+    struct where_refs refs = {0};
     unsigned len;
     const char *comment = NULL;
     char ip_string[17];
     qword absip = ip;
     int bits = (pe->magic == 0x10b) ? 32 : 64;
 
-    if (!pe_rel_addr)
+    if (!pe->rel_addr)
         absip += pe->imagebase;
 
     len = get_instr(ip, p, &instr, bits);
 
-    sprintf(ip_string, "%8lx", absip);
-
     /* Check for relocations and imported names. PE separates the two concepts:
      * imported names are done by jumping into a block in .idata which is
      * relocated, and relocations proper are scattered throughout code sections
      * and relocated according to the contents of .reloc. */
 
-    if (!(comment = get_arg_comment(sec, ip + len, &instr, &instr.args[0], pe)))
-        comment = get_arg_comment(sec, ip + len, &instr, &instr.args[1], pe);
+    if (!(comment = get_arg_comment(sec, ip + len, &instr, &instr.args[0], pe, &refs.import)))
+        comment = get_arg_comment(sec, ip + len, &instr, &instr.args[1], pe, &refs.import);
 
     /* We deal in relative addresses internally everywhere. That means we have
      * to fix up the values for relative jumps if we're not displaying relative
      * addresses. */
-    if ((instr.op.arg0 == REL8 || instr.op.arg0 == REL) && !pe_rel_addr) {
+    if ((instr.op.arg0 == REL8 || instr.op.arg0 == REL) && !pe->rel_addr) {
         instr.args[0].value += pe->imagebase;
     }
 
-    print_instr(ip_string, p, len, sec->instr_flags[ip - sec->address], &instr, comment, bits);
+    if (where_enabled()) {
+        where_add_operands(&refs, &instr, 0, absip + len);
+        if (!where_match(&instr, &refs))
+            return len;
+    }
+
+    sprintf(ip_string, "%8lx", absip);
+    print_instr(ip_string, 0, absip, p, len, sec->instr_flags[ip - sec->address], &instr, comment, bits);
 
     return len;
 }
@@ -237,12 +256,14 @@ static void print_disassembly(const struct section *sec, const struct pe *pe) {
             if (opts & DISASSEMBLE_ALL) {
                 /* still skip zeroes */
                 if (read_byte(sec->offset + relip) == 0) {
-                    printf("     ...\n");
+                    if (output_format == FORMAT_TEXT && !where_enabled())
+                        fprintf(out, "     ...\n");
                     relip++;
-                    while (read_byte(sec->offset + relip) == 0) relip++;
+                    while (relip < sec->length && read_byte(sec->offset + relip) == 0) relip++;
                 }
             } else {
-                printf("     ...\n");
+                if (output_format == FORMAT_TEXT && !where_enabled())
+                    fprintf(out, "     ...\n");
                 while ((relip < sec->length) && (relip < sec->min_alloc) && !(sec->instr_flags[relip] & INSTR_VALID)) relip++;
             }
         }
@@ -256,18 +277,92 @@ static void print_disassembly(const struct section *sec, const struct pe *pe) {
         memcpy(buffer, read_data(sec->offset + relip), min(sizeof(buffer), sec->length - relip));
 
         absip = ip;
-        if (!pe_rel_addr)
+        if (!pe->rel_addr)
             absip += pe->imagebase;
 
         if (sec->instr_flags[relip] & INSTR_FUNC) {
             const char *name = get_export_name(ip, pe);
-            printf("\n");
-            printf("%lx <%s>:\n", absip, name ? name : "no name");
+            if (output_format != FORMAT_TEXT) {
+                index_function(name, 0, absip);
+                record_begin("function");
+                record_address("address", absip);
+                if (name) record_string("name", name);
+                record_end();
+            } else {
+                fprintf(out, "\n");
+                index_function(name, 0, absip);
+                fprintf(out, "%lx <%s>:\n", absip, name ? name : "no name");
+            }
         }
 
         relip += print_pe_instr(sec, ip, buffer, pe);
     }
-    putchar('\n');
+    if (output_format == FORMAT_TEXT)
+        putc('\n', out);
+}
+
+/* With --dedup, a code section's output is reused from an earlier file if it
+ * would be the same. Comments can refer to any other section, so the key
+ * covers the contents of every section, the section table, and the header
+ * fields we use; the rest of the headers (such as the time stamp and
+ * checksum) and anything after the last section (such as a signature) may
+ * differ. It also covers the options that change how code is printed, since
+ * a server's requests can each give different ones. The key is left in ctx,
+ * to be finished with each section's address. Returns 0 if output can't be
+ * reused. */
+static int get_image_key(const struct pe *pe, struct sha256 *ctx) {
+    dword entry_point = (pe->magic == 0x10b) ? pe->opt32->AddressOfEntryPoint : pe->opt64->AddressOfEntryPoint;
+    /* We don't use any directories past the 16 defined ones, and there may
+     * not be that many in the file. */
+    unsigned dir_count = min(pe->dir_count, 16);
+    int i;
+
+    /* Index entries and binary strings aren't in the output we keep, and
+     * the key doesn't cover --where. */
+    if (!dedup || index_enabled() || where_enabled() || output_format == FORMAT_BINARY)
+        return 0;
+
+    sha256_init(ctx);
+    sha256_update(ctx, &asm_syntax, sizeof(asm_syntax));
+    sha256_update(ctx, &opts, sizeof(opts));
+    sha256_update(ctx, &output_format, sizeof(output_format));
+    sha256_update(ctx, &pe->magic, sizeof(pe->magic));
+    sha256_update(ctx, &pe->imagebase, sizeof(pe->imagebase));
+    sha256_update(ctx, &pe->rel_addr, sizeof(pe->rel_addr));
+    sha256_update(ctx, &entry_point, sizeof(entry_point));
+    /* Skip the certificate table. */
+    sha256_update(ctx, pe->dirs, min(dir_count, 4) * sizeof(struct directory));
+    if (dir_count > 5)
+        sha256_update(ctx, pe->dirs + 5, (dir_count - 5) * sizeof(struct directory));
+
+    for (i = 0; i < pe->header->NumberOfSections; i++) {
+        const struct section *sec = &pe->sections[i];
+
+        sha256_update(ctx, sec, offsetof(struct section, instr_flags));
+        if (sec->offset < map_size)
+            sha256_update(ctx, map + sec->offset, min(sec->length, map_size - sec->offset));
+    }
+    return 1;
+}
+
+/* image_key is NULL if output can't be reused. */
+static void print_code(const struct section *sec, const struct pe *pe, const struct sha256 *image_key) {
+    struct sha256 ctx;
+    struct dedup_key key;
+
+    if (!image_key) {
+        print_disassembly(sec, pe);
+        return;
+    }
+
+    ctx = *image_key;
+    sha256_update(&ctx, &sec->address, sizeof(sec->address));
+    sha256_final(&ctx, key.digest);
+    if (dedup_section_print(&key))
+        return;
+    dedup_section_begin();
+    print_disassembly(sec, pe);
+    dedup_section_end(&key);
 }
 
 static void print_data(const struct section *sec, struct pe *pe) {
@@ -283,23 +378,23 @@ static void print_data(const struct section *sec, struct pe *pe) {
         int i;
 
         absip = relip + sec->address;
-        if (!pe_rel_addr)
+        if (!pe->rel_addr)
             absip += pe->imagebase;
 
-        printf("%8lx", absip);
+        fprintf(out, "%8lx", absip);
         for (i=0; i<16; i++) {
             if (i < len)
-                printf(" %02x", read_byte(sec->offset + relip + i));
+                fprintf(out, " %02x", read_byte(sec->offset + relip + i));
             else
-                printf("   ");
+                fprintf(out, "   ");
         }
-        printf("  ");
+        fprintf(out, "  ");
         for (i = 0; i < len; ++i)
         {
             char c = read_byte(sec->offset + relip + i);
-            putchar(isprint(c) ? c : '.');
+            putc(isprint(c) ? c : '.', out);
         }
-        putchar('\n');
+        putc('\n', out);
     }
 }
 
@@ -319,6 +414,11 @@ static void scan_segment(dword ip, struct pe *pe) {
         return;
     }
 
+    if (!sec->instr_flags) {
+        warn_at("Attempt to scan byte not in a code section.\n");
+        return;
+    }
+
     relip = ip - sec->address;
 
     if ((sec->instr_flags[relip] & (INSTR_VALID|INSTR_SCANNED)) == INSTR_SCANNED)
@@ -327,7 +427,7 @@ static void scan_segment(dword ip, struct pe *pe) {
     /* This code assumes that one stretch of code won't span multiple sections.
      * Is this a valid assumption? */
 
-    while (relip < sec->length) {
+    while (relip < sec->length && relip < sec->min_alloc) {
         /* check if we've already read from here */
         if (sec->instr_flags[relip] & INSTR_SCANNED) return;
 
@@ -453,20 +553,17 @@ static void print_section_flags(dword flags) {
     if (flags & 0x40000000) strcat(buffer, ", readable");
     if (flags & 0x80000000) strcat(buffer, ", writable");
 
-    printf("    Flags: 0x%08x (%s)\n", flags, buffer+2);
-    printf("    Alignment: %d (2**%d)\n", 1 << alignment, alignment);
+    fprintf(out, "    Flags: 0x%08x (%s)\n", flags, buffer+2);
+    fprintf(out, "    Alignment: %d (2**%d)\n", 1 << alignment, alignment);
 }
 
 /* We don't actually know what sections contain code. In theory it could be any
  * of them. Fortunately we actually have everything we need already. */
 
-void read_sections(struct pe *pe) {
+static void scan_sections(struct pe *pe) {
     dword entry_point = (pe->magic == 0x10b) ? pe->opt32->AddressOfEntryPoint : pe->opt64->AddressOfEntryPoint;
     int i;
 
-    /* We already read the section header (unlike NE, we had to in order to read
-     * everything else), so our job now is just to scan the section contents. */
-
     /* Relocations first. */
     for (i = 0; i < pe->reloc_count; i++) {
         dword address = pe->relocs[i].offset;
@@ -521,17 +618,70 @@ void read_sections(struct pe *pe) {
     }
 }
 
+void read_sections(struct pe *pe) {
+    struct cache_array *arrays;
+    struct cache_key key;
+    unsigned count = 0;
+    int i;
+
+    /* We already read the section header (unlike NE, we had to in order to read
+     * everything else), so our job now is just to scan the section contents. */
+    map_set_phase(MAP_SCAN);
+
+    if (!cache_enabled()) {
+        scan_sections(pe);
+        return;
+    }
+
+    arrays = arena_alloc(&file_arena, pe->header->NumberOfSections * sizeof(*arrays));
+    for (i = 0; i < pe->header->NumberOfSections; i++) {
+        if (pe->sections[i].instr_flags) {
+            arrays[count].data = pe->sections[i].instr_flags;
+            arrays[count].size = pe->sections[i].min_alloc;
+            count++;
+        }
+    }
+
+    if (!cache_load(&key, arrays, count)) {
+        scan_sections(pe);
+        cache_store(&key, arrays, count);
+    }
+}
+
 void print_sections(struct pe *pe) {
     int i;
     struct section *sec;
+    qword base = pe->rel_addr ? 0 : pe->imagebase;
+    struct sha256 image_ctx;
+    const struct sha256 *image_key = get_image_key(pe, &image_ctx) ? &image_ctx : NULL;
+
+    map_set_phase(MAP_PRINT);
 
     for (i = 0; i < pe->header->NumberOfSections; i++) {
         sec = &pe->sections[i];
 
-        putchar('\n');
-        printf("Section %s (start = 0x%x, length = 0x%x, minimum allocation = 0x%x):\n",
+        if (output_format != FORMAT_TEXT) {
+            /* Only code is printed as records, so that's all there is. */
+            index_section(sec->name, strnlen(sec->name, sizeof(sec->name)), 0, base + sec->address);
+            record_begin("section");
+            record_stringn("name", sec->name, strnlen(sec->name, sizeof(sec->name)));
+            record_uint("offset", sec->offset);
+            record_uint("length", sec->length);
+            record_uint("min_alloc", sec->min_alloc);
+            record_address("address", sec->address);
+            record_uint("flags", sec->flags);
+            record_end();
+            if (sec->flags & 0x20)
+                print_code(sec, pe, image_key);
+            map_release(sec->offset, sec->length);
+            continue;
+        }
+
+        putc('\n', out);
+        index_section(sec->name, strnlen(sec->name, sizeof(sec->name)), 0, base + sec->address);
+        fprintf(out, "Section %s (start = 0x%x, length = 0x%x, minimum allocation = 0x%x):\n",
             sec->name, sec->offset, sec->length, sec->min_alloc);
-        printf("    Address: %x\n", sec->address);
+        fprintf(out, "    Address: %x\n", sec->address);
         print_section_flags(sec->flags);
 
         /* These fields should only be populated for object files (I think). */
@@ -544,7 +694,7 @@ void print_sections(struct pe *pe) {
         if (sec->flags & 0x20) {
             if (opts & FULL_CONTENTS)
                 print_data(sec, pe);
-            print_disassembly(sec, pe);
+            print_code(sec, pe, image_key);
         } else if (sec->flags & 0x40) {
             /* see the appropriate FIXMEs on the NE side */
             /* Don't print .rsrc by default. Some others should probably be
@@ -554,5 +704,7 @@ void print_sections(struct pe *pe) {
                 || (opts & FULL_CONTENTS))
                 print_data(sec, pe);
         }
+
+        map_release(sec->offset, sec->length);
     }
 }
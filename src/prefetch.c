@@ -0,0 +1,323 @@
+/*
+ * Reading ahead the files about to be dumped
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "semblance.h"
+#include "input.h"
+#include "prefetch.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+/* When dumping many files from cold storage, most of the time is spent
+ * waiting for page faults. So we keep a queue of the next few files, and ask
+ * the kernel to start reading them while we're busy with the current one.
+ *
+ * With io_uring, this happens in two steps: first we read the header of each
+ * file, and once that arrives we ask for just the parts of the file that we'll
+ * look at (i.e. the sections, but not any appended data). Without io_uring we
+ * just ask for the whole file. */
+
+#define HEADER_SIZE 4096
+
+struct prefetch_slot {
+    char *name;
+    int fd;
+    int reading;    /* the header is still being read */
+    byte header[HEADER_SIZE];
+};
+
+static struct prefetch_slot *slots;
+static unsigned depth, head, count;
+static int input_done;
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+static struct {
+    int fd;
+    unsigned entries;
+    unsigned to_submit;
+
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+} ring = {-1};
+
+static void init_ring(unsigned entries)
+{
+    struct io_uring_params params;
+    size_t sq_size, cq_size;
+    byte *sq, *cq;
+    int fd;
+
+    memset(&params, 0, sizeof(params));
+    if ((fd = syscall(__NR_io_uring_setup, entries, &params)) < 0)
+        return;
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        sq_size = cq_size = (sq_size > cq_size ? sq_size : cq_size);
+
+    sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        cq = sq;
+    else if ((cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+    ring.sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+
+    ring.sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring.sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring.sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring.sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring.cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring.cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring.cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring.entries = params.sq_entries;
+    ring.fd = fd;
+}
+
+static void submit(unsigned wait)
+{
+    int ret;
+
+    do {
+        ret = syscall(__NR_io_uring_enter, ring.fd, ring.to_submit, wait,
+                wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret > 0)
+        ring.to_submit -= min((unsigned)ret, ring.to_submit);
+}
+
+static struct io_uring_sqe *get_sqe(void)
+{
+    unsigned tail = *ring.sq_tail, index;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) == ring.entries) {
+        submit(0);
+        if (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) == ring.entries)
+            return NULL;
+    }
+
+    index = tail & *ring.sq_mask;
+    sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring.sq_array[index] = index;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring.to_submit++;
+    return sqe;
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
+
+static void advise(int fd, off_t offset, off_t length)
+{
+#ifdef HAVE_LINUX_IO_URING_H
+    struct io_uring_sqe *sqe;
+
+    if (ring.fd >= 0 && length <= 0xffffffff && (sqe = get_sqe()))
+    {
+        sqe->opcode = IORING_OP_FADVISE;
+        sqe->fd = fd;
+        sqe->off = offset;
+        sqe->len = length;
+        sqe->fadvise_advice = POSIX_FADV_WILLNEED;
+        return;
+    }
+#endif
+    posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+}
+
+/* Ask for the parts of the file that we'll actually read. NE images are small,
+ * and their relocations and resources are scattered about, so just ask for
+ * all of them. */
+static void advise_image(const struct prefetch_slot *slot, size_t size)
+{
+    const byte *header = slot->header;
+    unsigned i, section_count;
+    dword offset, sections;
+
+    if (size < 0x40 || *(word *)header != 0x5a4d) {
+        advise(slot->fd, 0, 0);
+        return;
+    }
+
+    offset = *(dword *)(header + 0x3c);
+    if (offset > size - 0x18 || *(dword *)(header + offset) != 0x4550) {
+        advise(slot->fd, 0, 0);
+        return;
+    }
+
+    section_count = *(word *)(header + offset + 6);
+    sections = offset + 0x18 + *(word *)(header + offset + 0x14);
+
+    advise(slot->fd, 0, HEADER_SIZE);
+    for (i = 0; i < section_count && sections + (i + 1) * 0x28 <= size; i++)
+    {
+        dword length = *(dword *)(header + sections + i * 0x28 + 0x10);
+        dword start = *(dword *)(header + sections + i * 0x28 + 0x14);
+
+        if (length)
+            advise(slot->fd, start, length);
+    }
+}
+
+static void reap(unsigned wait)
+{
+#ifdef HAVE_LINUX_IO_URING_H
+    unsigned cq_head, cq_tail;
+
+    if (ring.fd < 0)
+        return;
+
+    if (wait || ring.to_submit)
+        submit(wait);
+
+    cq_head = *ring.cq_head;
+    cq_tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    for (; cq_head != cq_tail; cq_head++)
+    {
+        const struct io_uring_cqe *cqe = &ring.cqes[cq_head & *ring.cq_mask];
+        struct prefetch_slot *slot;
+
+        /* Advice has no result worth looking at. */
+        if (!cqe->user_data)
+            continue;
+
+        slot = &slots[cqe->user_data - 1];
+        slot->reading = 0;
+        if (cqe->res > 0)
+            advise_image(slot, cqe->res);
+        else
+            advise(slot->fd, 0, 0);
+    }
+    __atomic_store_n(ring.cq_head, cq_head, __ATOMIC_RELEASE);
+
+    /* Send off any advice we just queued, while the file is still open. */
+    if (ring.to_submit)
+        submit(0);
+#endif
+}
+
+static void fill(void)
+{
+    struct prefetch_slot *slot;
+    char *name;
+
+    while (count < depth && !input_done)
+    {
+        if (!(name = input_next())) {
+            input_done = 1;
+            break;
+        }
+
+        slot = &slots[(head + count++) % depth];
+        slot->name = name;
+        slot->reading = 0;
+
+        /* If we can't open it, dump_file() will say so. */
+        if ((slot->fd = open(name, O_RDONLY | O_CLOEXEC)) < 0)
+            continue;
+
+#ifdef HAVE_LINUX_IO_URING_H
+        if (ring.fd >= 0) {
+            struct io_uring_sqe *sqe;
+
+            if ((sqe = get_sqe())) {
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = slot->fd;
+                sqe->addr = (unsigned long)slot->header;
+                sqe->len = HEADER_SIZE;
+                sqe->off = 0;
+                sqe->user_data = (slot - slots) + 1;
+                slot->reading = 1;
+                continue;
+            }
+        }
+#endif
+        advise(slot->fd, 0, 0);
+    }
+
+    reap(0);
+}
+
+void prefetch_init(unsigned files)
+{
+    depth = files;
+    slots = calloc(depth, sizeof(*slots));
+#ifdef HAVE_LINUX_IO_URING_H
+    /* One header read per file, and a few pieces of advice per section. */
+    init_ring(depth * 16 < 4096 ? depth * 16 : 4096);
+#endif
+}
+
+char *prefetch_next(void)
+{
+    struct prefetch_slot *slot;
+    char *name;
+
+    if (!depth)
+        return input_next();
+
+    fill();
+    if (!count)
+        return NULL;
+
+    slot = &slots[head];
+    while (slot->reading)
+        reap(1);
+
+    if (slot->fd >= 0)
+        close(slot->fd);
+    name = slot->name;
+    head = (head + 1) % depth;
+    count--;
+
+    /* Keep the queue full while this one is dumped. */
+    fill();
+    return name;
+}
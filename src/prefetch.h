@@ -0,0 +1,10 @@
+#ifndef __PREFETCH_H
+#define __PREFETCH_H
+
+/* Start reading the next "files" files before they are dumped. */
+extern void prefetch_init(unsigned files);
+
+/* Like input_next(), but reading ahead if prefetch_init() was called. */
+extern char *prefetch_next(void);
+
+#endif /* __PREFETCH_H */
@@ -0,0 +1,409 @@
+/*
+ * Writing records, for --format=jsonl and --format=binary
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "semblance.h"
+#include "record.h"
+#include "record_reader.h"
+
+/* JSON Lines */
+
+/* For each byte, the character to write after a backslash, or 'u' to write it
+ * as \u00xx. Names in these files are in whatever code page the author used,
+ * and aren't necessarily valid UTF-8, so anything outside of ASCII is written
+ * as if it were Latin-1. */
+static const char escapes[256] =
+{
+    [0x00 ... 0x1f] = 'u',
+    ['\b'] = 'b',
+    ['\t'] = 't',
+    ['\n'] = 'n',
+    ['\f'] = 'f',
+    ['\r'] = 'r',
+    ['"'] = '"',
+    ['\\'] = '\\',
+    [0x7f ... 0xff] = 'u',
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* Whether the current array is still empty. */
+static __thread int array_empty;
+
+/* Write runs of characters which don't need escaping in one go, since that's
+ * almost all of them. */
+static void write_escaped(const char *str, size_t len)
+{
+    const byte *p = (const byte *)str, *end = p + len, *run = p;
+    char buffer[6] = {'\\', 'u', '0', '0'};
+
+    for (; p < end; p++)
+    {
+        if (!escapes[*p])
+            continue;
+
+        fwrite(run, 1, p - run, out);
+        if (escapes[*p] == 'u')
+        {
+            buffer[4] = hex_digits[*p >> 4];
+            buffer[5] = hex_digits[*p & 0xf];
+            fwrite(buffer, 1, 6, out);
+        }
+        else
+        {
+            buffer[1] = escapes[*p];
+            fwrite(buffer, 1, 2, out);
+            buffer[1] = 'u';
+        }
+        run = p + 1;
+    }
+    fwrite(run, 1, p - run, out);
+}
+
+/* Keys are always literals of ours, so they don't need escaping. */
+static void write_key(const char *key)
+{
+    fprintf(out, ",\"%s\":", key);
+}
+
+static void write_string(const char *value, size_t len)
+{
+    putc('"', out);
+    write_escaped(value, len);
+    putc('"', out);
+}
+
+static void write_hex(const byte *data, size_t len)
+{
+    char buffer[64];
+    size_t i, n = 0;
+
+    putc('"', out);
+    for (i = 0; i < len; i++)
+    {
+        buffer[n++] = hex_digits[data[i] >> 4];
+        buffer[n++] = hex_digits[data[i] & 0xf];
+        if (n == sizeof(buffer))
+        {
+            fwrite(buffer, 1, n, out);
+            n = 0;
+        }
+    }
+    fwrite(buffer, 1, n, out);
+    putc('"', out);
+}
+
+/* Binary */
+
+/* The record being built. It has to be written after any strings it uses
+ * are defined, and its length has to be written before it. */
+static __thread byte *record_data;
+static __thread size_t record_len, record_size;
+
+/* The strings defined so far for this file. */
+struct string_entry
+{
+    unsigned hash;
+    unsigned id;
+    const char *str;
+    size_t len;
+};
+
+static __thread struct string_entry *strings;
+static __thread unsigned string_count, string_size;
+static __thread struct arena string_arena;
+
+static void put_data(const void *data, size_t len)
+{
+    if (record_len + len > record_size)
+    {
+        while (record_len + len > record_size)
+            record_size = record_size ? record_size * 2 : 256;
+        record_data = realloc(record_data, record_size);
+    }
+    memcpy(record_data + record_len, data, len);
+    record_len += len;
+}
+
+static size_t encode_varint(byte *buffer, qword value)
+{
+    size_t len = 0;
+
+    while (value >= 0x80)
+    {
+        buffer[len++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buffer[len++] = value;
+    return len;
+}
+
+static void put_varint(qword value)
+{
+    byte buffer[10];
+
+    put_data(buffer, encode_varint(buffer, value));
+}
+
+static void put_byte(byte value)
+{
+    put_data(&value, 1);
+}
+
+static void write_frame(byte kind, const void *data, size_t len)
+{
+    byte buffer[10];
+
+    putc(kind, out);
+    fwrite(buffer, 1, encode_varint(buffer, len), out);
+    fwrite(data, 1, len, out);
+}
+
+static unsigned hash_string(const char *str, size_t len)
+{
+    unsigned hash = 2166136261u;
+
+    while (len--)
+        hash = (hash ^ (byte)*str++) * 16777619u;
+    return hash;
+}
+
+static struct string_entry *find_string(unsigned hash, const char *str, size_t len)
+{
+    struct string_entry *entry;
+    unsigned h;
+
+    for (h = hash & (string_size - 1); (entry = &strings[h])->id; h = (h + 1) & (string_size - 1))
+    {
+        if (entry->hash == hash && entry->len == len && !memcmp(entry->str, str, len))
+            break;
+    }
+    return entry;
+}
+
+/* Get the number of a string, defining it if we haven't seen it yet in this
+ * file. Mnemonics, registers, and names repeat a lot, so this is most of what
+ * makes the format small. */
+static unsigned intern(const char *str, size_t len)
+{
+    unsigned hash = hash_string(str, len), i;
+    struct string_entry *entry;
+
+    if ((string_count + 1) * 2 > string_size)
+    {
+        struct string_entry *old = strings;
+        unsigned old_size = string_size;
+
+        string_size = string_size ? string_size * 2 : 1024;
+        strings = calloc(string_size, sizeof(*strings));
+        for (i = 0; i < old_size; i++)
+        {
+            if (old[i].id)
+                *find_string(old[i].hash, old[i].str, old[i].len) = old[i];
+        }
+        free(old);
+    }
+
+    entry = find_string(hash, str, len);
+    if (!entry->id)
+    {
+        entry->hash = hash;
+        entry->id = ++string_count;
+        entry->str = arena_strndup(&string_arena, str, len);
+        entry->len = len;
+        write_frame(REC_FRAME_STRING, str, len);
+    }
+    return entry->id;
+}
+
+static void put_key(const char *key, enum rec_tag tag)
+{
+    put_varint(intern(key, strlen(key)));
+    put_byte(tag);
+}
+
+/* Records */
+
+size_t record_stream_begin(void)
+{
+    byte buffer[10];
+    size_t len;
+
+    if (output_format != FORMAT_BINARY)
+        return 0;
+    len = encode_varint(buffer, REC_VERSION);
+    fwrite(REC_MAGIC, 1, strlen(REC_MAGIC), out);
+    fwrite(buffer, 1, len, out);
+    return strlen(REC_MAGIC) + len;
+}
+
+void record_file_begin(void)
+{
+    if (output_format != FORMAT_BINARY)
+        return;
+    if (string_count)
+        memset(strings, 0, string_size * sizeof(*strings));
+    string_count = 0;
+    arena_free(&string_arena);
+    write_frame(REC_FRAME_FILE, NULL, 0);
+}
+
+void record_thread_end(void)
+{
+    free(strings);
+    strings = NULL;
+    string_count = string_size = 0;
+    arena_free(&string_arena);
+    free(record_data);
+    record_data = NULL;
+    record_len = record_size = 0;
+}
+
+void record_begin(const char *type)
+{
+    if (output_format == FORMAT_BINARY)
+    {
+        record_len = 0;
+        put_varint(intern(type, strlen(type)));
+    }
+    else
+        fprintf(out, "{\"type\":\"%s\"", type);
+}
+
+void record_end(void)
+{
+    if (output_format == FORMAT_BINARY)
+        write_frame(REC_FRAME_RECORD, record_data, record_len);
+    else
+        fputs("}\n", out);
+}
+
+void record_stringn(const char *key, const char *value, size_t len)
+{
+    if (output_format == FORMAT_BINARY)
+    {
+        put_key(key, REC_STRING);
+        put_varint(intern(value, len));
+    }
+    else
+    {
+        write_key(key);
+        write_string(value, len);
+    }
+}
+
+void record_string(const char *key, const char *value)
+{
+    record_stringn(key, value, strlen(value));
+}
+
+void record_uint(const char *key, qword value)
+{
+    if (output_format == FORMAT_BINARY)
+    {
+        put_key(key, REC_UINT);
+        put_varint(value);
+    }
+    else
+        fprintf(out, ",\"%s\":%lu", key, value);
+}
+
+void record_bool(const char *key, int value)
+{
+    if (output_format == FORMAT_BINARY)
+        put_key(key, value ? REC_TRUE : REC_FALSE);
+    else
+        fprintf(out, ",\"%s\":%s", key, value ? "true" : "false");
+}
+
+void record_address(const char *key, qword address)
+{
+    if (output_format == FORMAT_BINARY)
+    {
+        put_key(key, REC_ADDRESS);
+        put_varint(address);
+    }
+    else
+        fprintf(out, ",\"%s\":\"%lx\"", key, address);
+}
+
+void record_far_address(const char *key, word segment, word offset)
+{
+    if (output_format == FORMAT_BINARY)
+    {
+        put_key(key, REC_FAR_ADDRESS);
+        put_varint(segment);
+        put_varint(offset);
+    }
+    else
+        fprintf(out, ",\"%s\":\"%d:%04x\"", key, segment, offset);
+}
+
+void record_bytes(const char *key, const byte *data, size_t len)
+{
+    if (output_format == FORMAT_BINARY)
+    {
+        put_key(key, REC_BYTES);
+        put_varint(len);
+        put_data(data, len);
+    }
+    else
+    {
+        write_key(key);
+        write_hex(data, len);
+    }
+}
+
+void record_array_begin(const char *key)
+{
+    if (output_format == FORMAT_BINARY)
+        put_key(key, REC_ARRAY);
+    else
+    {
+        write_key(key);
+        putc('[', out);
+        array_empty = 1;
+    }
+}
+
+void record_array_string(const char *value)
+{
+    if (output_format == FORMAT_BINARY)
+        put_varint(intern(value, strlen(value)));
+    else
+    {
+        if (!array_empty)
+            putc(',', out);
+        array_empty = 0;
+        write_string(value, strlen(value));
+    }
+}
+
+void record_array_end(void)
+{
+    if (output_format == FORMAT_BINARY)
+        put_varint(0);
+    else
+        putc(']', out);
+}
@@ -0,0 +1,33 @@
+#ifndef __RECORD_H
+#define __RECORD_H
+
+#include "semblance.h"
+
+/* Records are printed instead of a listing with --format=jsonl or
+ * --format=binary. Each record is written with record_begin(), then its
+ * fields in order, then record_end(). */
+extern void record_begin(const char *type);
+extern void record_end(void);
+
+extern void record_string(const char *key, const char *value);
+extern void record_stringn(const char *key, const char *value, size_t len);
+extern void record_uint(const char *key, qword value);
+extern void record_bool(const char *key, int value);
+extern void record_address(const char *key, qword address);
+extern void record_far_address(const char *key, word segment, word offset);
+/* Binary data, which is written as a string of hex digits in JSON. */
+extern void record_bytes(const char *key, const byte *data, size_t len);
+
+extern void record_array_begin(const char *key);
+extern void record_array_string(const char *value);
+extern void record_array_end(void);
+
+/* Call at the start of the output, and at the start of each file.
+ * record_stream_begin() returns how many bytes it printed. */
+extern size_t record_stream_begin(void);
+extern void record_file_begin(void);
+
+/* Free what a thread used for writing records. */
+extern void record_thread_end(void);
+
+#endif /* __RECORD_H */
@@ -0,0 +1,215 @@
+/*
+ * Reading the binary record stream
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "record_reader.h"
+
+/* Read a varint, or return 0 if it runs past the end or doesn't fit. */
+static int read_varint(const unsigned char **cursor, const unsigned char *end, uint64_t *value)
+{
+    const unsigned char *p = *cursor;
+    unsigned shift = 0;
+
+    *value = 0;
+    while (p < end && shift < 64)
+    {
+        *value |= (uint64_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80))
+        {
+            *cursor = p;
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+static int read_string(struct rec_reader *reader, const unsigned char **cursor,
+        const unsigned char *end, struct rec_string *string)
+{
+    uint64_t id;
+
+    if (!read_varint(cursor, end, &id) || !id || id > reader->string_count)
+        return 0;
+    *string = reader->strings[id - 1];
+    return 1;
+}
+
+static int add_string(struct rec_reader *reader, const unsigned char *data, size_t len)
+{
+    if (reader->string_count == reader->string_size)
+    {
+        unsigned size = reader->string_size ? reader->string_size * 2 : 1024;
+        struct rec_string *strings = realloc(reader->strings, size * sizeof(*strings));
+
+        if (!strings)
+            return 0;
+        reader->strings = strings;
+        reader->string_size = size;
+    }
+    reader->strings[reader->string_count].id = reader->string_count + 1;
+    reader->strings[reader->string_count].data = (const char *)data;
+    reader->strings[reader->string_count].len = len;
+    reader->string_count++;
+    return 1;
+}
+
+int rec_reader_init(struct rec_reader *reader, const void *data, size_t size)
+{
+    size_t magic_len = strlen(REC_MAGIC);
+    uint64_t version;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->cursor = data;
+    reader->end = reader->cursor + size;
+
+    if (size < magic_len || memcmp(data, REC_MAGIC, magic_len))
+        return 0;
+    reader->cursor += magic_len;
+    if (!read_varint(&reader->cursor, reader->end, &version) || version != REC_VERSION)
+        return 0;
+    return 1;
+}
+
+void rec_reader_free(struct rec_reader *reader)
+{
+    free(reader->strings);
+    memset(reader, 0, sizeof(*reader));
+}
+
+int rec_next_record(struct rec_reader *reader, struct rec_record *record)
+{
+    while (reader->cursor < reader->end)
+    {
+        const unsigned char *payload;
+        unsigned char kind = *reader->cursor++;
+        uint64_t len;
+
+        if (!read_varint(&reader->cursor, reader->end, &len)
+                || len > (uint64_t)(reader->end - reader->cursor))
+            return -1;
+        payload = reader->cursor;
+        reader->cursor += len;
+
+        switch (kind)
+        {
+        case REC_FRAME_FILE:
+            reader->string_count = 0;
+            break;
+        case REC_FRAME_STRING:
+            if (!add_string(reader, payload, len))
+                return -1;
+            break;
+        case REC_FRAME_RECORD:
+            record->cursor = payload;
+            record->end = payload + len;
+            if (!read_string(reader, &record->cursor, record->end, &record->type))
+                return -1;
+            return 1;
+        default:
+            /* Frames we don't know about can be skipped, since they have a
+             * length. */
+            break;
+        }
+    }
+    return 0;
+}
+
+int rec_next_field(struct rec_reader *reader, struct rec_record *record, struct rec_field *field)
+{
+    const unsigned char *end = record->end;
+    uint64_t value;
+
+    if (record->cursor == end)
+        return 0;
+    if (!read_string(reader, &record->cursor, end, &field->key) || record->cursor == end)
+        return -1;
+    field->tag = *record->cursor++;
+
+    switch (field->tag)
+    {
+    case REC_UINT:
+    case REC_ADDRESS:
+        if (!read_varint(&record->cursor, end, &field->uint))
+            return -1;
+        break;
+    case REC_STRING:
+        if (!read_string(reader, &record->cursor, end, &field->string))
+            return -1;
+        break;
+    case REC_BYTES:
+        if (!read_varint(&record->cursor, end, &value)
+                || value > (uint64_t)(end - record->cursor))
+            return -1;
+        field->bytes.data = record->cursor;
+        field->bytes.len = value;
+        record->cursor += value;
+        break;
+    case REC_FALSE:
+    case REC_TRUE:
+        break;
+    case REC_ARRAY:
+        /* Skip over the elements now, so that the caller doesn't have to. */
+        field->array.cursor = record->cursor;
+        do
+        {
+            if (!read_varint(&record->cursor, end, &value) || value > reader->string_count)
+                return -1;
+        } while (value);
+        break;
+    case REC_FAR_ADDRESS:
+        if (!read_varint(&record->cursor, end, &value) || value > 0xffff)
+            return -1;
+        field->far_address.segment = value;
+        if (!read_varint(&record->cursor, end, &value) || value > 0xffff)
+            return -1;
+        field->far_address.offset = value;
+        break;
+    default:
+        /* We can't know how long the value is, so we can't go on. */
+        return -1;
+    }
+    return 1;
+}
+
+int rec_next_element(struct rec_reader *reader, struct rec_field *field, struct rec_string *string)
+{
+    const unsigned char *cursor = field->array.cursor;
+    uint64_t id;
+
+    /* rec_next_field() already checked that the array is well-formed. */
+    read_varint(&cursor, cursor + 10, &id);
+    if (!id)
+        return 0;
+    if (id > reader->string_count)
+        return -1;
+    field->array.cursor = cursor;
+    *string = reader->strings[id - 1];
+    return 1;
+}
+
+int rec_string_is(const struct rec_string *string, const char *str)
+{
+    return strlen(str) == string->len && !memcmp(string->data, str, string->len);
+}
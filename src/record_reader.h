@@ -0,0 +1,107 @@
+#ifndef __RECORD_READER_H
+#define __RECORD_READER_H
+
+/* Reading the binary record stream written by `dump --format=binary'.
+ *
+ * The stream starts with the four bytes "SMBR" and a varint version. After
+ * that it is a series of frames, each a kind byte, a varint length, and that
+ * many bytes of payload:
+ *
+ * - REC_FRAME_FILE starts the records for a new file, and forgets the strings
+ *   defined so far. Its payload is empty.
+ * - REC_FRAME_STRING defines the next string, numbered from 1. Its payload is
+ *   the string, which isn't terminated.
+ * - REC_FRAME_RECORD is a record. Its payload is the string number of its
+ *   type, followed by its fields: each the string number of its key, a tag
+ *   byte, and the value.
+ *
+ * Varints are unsigned LEB128. The records and their fields are the same as
+ * those printed by --format=jsonl. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define REC_MAGIC           "SMBR"
+#define REC_VERSION         1
+
+#define REC_FRAME_FILE      'F'
+#define REC_FRAME_STRING    'S'
+#define REC_FRAME_RECORD    'R'
+
+enum rec_tag
+{
+    REC_UINT = 1,       /* varint */
+    REC_STRING,         /* varint string number */
+    REC_BYTES,          /* varint length, then the bytes */
+    REC_FALSE,
+    REC_TRUE,
+    REC_ARRAY,          /* string numbers, terminated by a zero */
+    REC_ADDRESS,        /* varint */
+    REC_FAR_ADDRESS,    /* varint segment, varint offset */
+};
+
+struct rec_string
+{
+    unsigned id;        /* the same string always has the same number in a file */
+    const char *data;   /* not terminated */
+    size_t len;
+};
+
+struct rec_field
+{
+    struct rec_string key;
+    enum rec_tag tag;
+    union
+    {
+        uint64_t uint;          /* REC_UINT and REC_ADDRESS */
+        struct rec_string string;
+        struct
+        {
+            const unsigned char *data;
+            size_t len;
+        } bytes;
+        struct
+        {
+            uint16_t segment;
+            uint16_t offset;
+        } far_address;
+        struct
+        {
+            const unsigned char *cursor;
+        } array;
+    };
+};
+
+struct rec_record
+{
+    struct rec_string type;
+    const unsigned char *cursor, *end;
+};
+
+struct rec_reader
+{
+    const unsigned char *cursor, *end;
+    struct rec_string *strings;
+    unsigned string_count, string_size;
+};
+
+/* Start reading a stream, which is usually mapped. Nothing is copied out of
+ * it, so it must stay around until rec_reader_free(). Returns 0 if the data
+ * isn't a record stream of a version we understand. */
+extern int rec_reader_init(struct rec_reader *reader, const void *data, size_t size);
+extern void rec_reader_free(struct rec_reader *reader);
+
+/* Get the next record, skipping over the frames in between. Returns 1 for a
+ * record, 0 at the end of the stream, or -1 if the stream is corrupt. */
+extern int rec_next_record(struct rec_reader *reader, struct rec_record *record);
+
+/* Get the next field of the record, with the same return values. */
+extern int rec_next_field(struct rec_reader *reader, struct rec_record *record, struct rec_field *field);
+
+/* Get the next element of a REC_ARRAY field, with the same return values. */
+extern int rec_next_element(struct rec_reader *reader, struct rec_field *field, struct rec_string *string);
+
+/* Whether a string is equal to the given C string. */
+extern int rec_string_is(const struct rec_string *string, const char *str);
+
+#endif /* __RECORD_READER_H */
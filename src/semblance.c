@@ -0,0 +1,181 @@
+/*
+ * Common globals, and mapping and dumping a file
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "semblance.h"
+#include "where.h"
+
+__thread byte *map;
+__thread off_t map_size;
+__thread int map_fd = -1;
+__thread int map_error;
+const byte map_zeroes[MAP_TAIL];
+__thread FILE *out;
+__thread struct arena file_arena;
+
+__thread word mode;
+__thread word opts;
+__thread char **resource_filters;
+__thread unsigned resource_filters_count;
+__thread const char *extract_dir;
+__thread enum asm_syntax asm_syntax = NASM;
+__thread enum output_format output_format;
+
+const char *program_name = "";
+__thread const char *file_name;
+__thread unsigned file_index;
+
+int map_advise;
+off_t map_populate_max;
+off_t map_huge_min;
+int map_dontneed;
+
+void options_save(struct options *options)
+{
+    options->mode = mode;
+    options->opts = opts;
+    options->asm_syntax = asm_syntax;
+    options->output_format = output_format;
+    options->resource_filters = resource_filters;
+    options->resource_filters_count = resource_filters_count;
+    options->extract_dir = extract_dir;
+    options->pe_rel_addr = pe_rel_addr;
+    options->where_clauses = where_clauses;
+    options->where_count = where_count;
+}
+
+void options_restore(const struct options *options)
+{
+    mode = options->mode;
+    opts = options->opts;
+    asm_syntax = options->asm_syntax;
+    output_format = options->output_format;
+    resource_filters = options->resource_filters;
+    resource_filters_count = options->resource_filters_count;
+    extract_dir = options->extract_dir;
+    pe_rel_addr = options->pe_rel_addr;
+    where_clauses = options->where_clauses;
+    where_count = options->where_count;
+}
+
+void map_set_phase(enum map_phase phase)
+{
+    if (map_advise)
+        madvise(map, map_size, phase == MAP_SCAN ? MADV_RANDOM : MADV_SEQUENTIAL);
+}
+
+/* We're done with this part of the file. Only whole pages inside it are
+ * dropped; if we do look at them again they'll just be faulted back in. */
+void map_release(off_t offset, off_t length)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    off_t start, end;
+
+    if (!map_dontneed || map_fd < 0 || offset >= map_size)
+        return;
+
+    start = (offset + page_size - 1) & ~(off_t)(page_size - 1);
+    end = min(offset + length, map_size) & ~(off_t)(page_size - 1);
+    if (end > start)
+        madvise(map + start, end - start, MADV_DONTNEED);
+}
+
+void map_read_error(off_t offset, size_t size)
+{
+    if (!map_error)
+        warn("Read of %zu bytes at %#jx is past the end of the file.\n", size, (intmax_t)offset);
+    map_error = 1;
+}
+
+static off_t mapped_size(off_t size)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    return (size + page_size - 1) & ~(off_t)(page_size - 1);
+}
+
+/* Map the file, followed by zeroes. */
+byte *map_file(int fd, off_t size)
+{
+    byte *region;
+
+    region = mmap(NULL, mapped_size(size) + MAP_TAIL, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+        return region;
+
+    if (mmap(region, size, PROT_READ,
+            MAP_PRIVATE | MAP_FIXED | (size <= map_populate_max ? MAP_POPULATE : 0), fd, 0) == MAP_FAILED) {
+        munmap(region, mapped_size(size) + MAP_TAIL);
+        return MAP_FAILED;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (map_huge_min && size >= map_huge_min)
+        madvise(region, size, MADV_HUGEPAGE);
+#endif
+    return region;
+}
+
+/* Copy a buffer into memory laid out the same way. */
+byte *map_buffer(const void *data, off_t size)
+{
+    byte *region;
+
+    region = mmap(NULL, mapped_size(size) + MAP_TAIL, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+        return region;
+    memcpy(region, data, size);
+    mprotect(region, mapped_size(size) + MAP_TAIL, PROT_READ);
+    return region;
+}
+
+void unmap_file(byte *region, off_t size)
+{
+    munmap(region, mapped_size(size) + MAP_TAIL);
+}
+
+/* Dump the file that's mapped. Returns 0 if it's not a format we know. */
+int dump_map(void)
+{
+    word magic = read_word(0);
+    off_t offset;
+
+    if (magic != 0x5a4d) /* MZ */
+        return 0;
+
+    offset = read_dword(0x3c);
+    magic = read_word(offset);
+
+    if (magic == 0x4550)
+        dumppe(offset);
+    else if (magic == 0x454e)
+        dumpne(offset);
+    else
+        dumpmz();
+    return 1;
+}
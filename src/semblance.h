@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "config.h"
+#include "arena.h"
 
 #define STATIC_ASSERT(e) extern void STATIC_ASSERT_(int [(e)?1:-1])
 
@@ -14,30 +15,97 @@ typedef uint16_t word;
 typedef uint32_t dword;
 typedef uint64_t qword;
 
-extern byte *map;
+/* Everything about the file being dumped is thread-local, so that several
+ * files can be dumped at once. */
+extern __thread byte *map;
+extern __thread off_t map_size;
+extern __thread int map_fd;
+
+/* Where to print the dump of the current file. */
+extern __thread FILE *out;
+
+/* What we parse out of the current file is allocated from here, and freed all
+ * at once by dumpmz(), dumpne(), or dumppe() when they're done. */
+extern __thread struct arena file_arena;
+
+/* Tell the mapping policy (--map) what we're about to do with the file. */
+enum map_phase
+{
+    MAP_SCAN,
+    MAP_PRINT,
+};
+extern void map_set_phase(enum map_phase phase);
+extern void map_release(off_t offset, off_t length);
+
+/* How files are mapped, from --map. By default we leave it to the kernel. */
+extern int map_advise;          /* random access while scanning, sequential while printing */
+extern off_t map_populate_max;  /* prefault files no larger than this */
+extern off_t map_huge_min;      /* ask for huge pages for files at least this large */
+extern int map_dontneed;        /* drop sections from the mapping once printed */
+
+/* Map a file, or copy a buffer, followed by MAP_TAIL bytes of zeroes. These
+ * return MAP_FAILED on failure. */
+extern byte *map_file(int fd, off_t size);
+extern byte *map_buffer(const void *data, off_t size);
+extern void unmap_file(byte *region, off_t size);
+
+/* Reads are checked against the size of the file, so that a truncated or
+ * malicious file can't crash us. A read past the end gives zeroes, and marks
+ * the file as corrupt (map_error).
+ *
+ * read_data() only checks the start of what's read. The mapping is followed
+ * by MAP_TAIL bytes of zeroes, so structures and strings that start inside
+ * the file can be read without checking their length; anything that walks
+ * further than that must check against map_size itself. */
+
+#define MAP_TAIL 0x10000
+
+extern __thread int map_error;
+extern const byte map_zeroes[MAP_TAIL];
+extern void map_read_error(off_t offset, size_t size) __attribute__((cold));
+
+static inline int map_check(off_t offset, size_t size)
+{
+    if (__builtin_expect((qword)offset + size > (qword)map_size, 0))
+    {
+        map_read_error(offset, size);
+        return 0;
+    }
+    return 1;
+}
 
 static inline const void *read_data(off_t offset)
 {
+    if (!map_check(offset, 0))
+        return map_zeroes;
     return map + offset;
 }
 
 static inline byte read_byte(off_t offset)
 {
+    if (!map_check(offset, sizeof(byte)))
+        return 0;
     return map[offset];
 }
 
 static inline word read_word(off_t offset)
 {
+    if (!map_check(offset, sizeof(word)))
+        return 0;
     return *(word *)(map + offset);
 }
 
 static inline dword read_dword(off_t offset)
 {
+    if (!map_check(offset, sizeof(dword)))
+        return 0;
     return *(dword *)(map + offset);
 }
 
 static inline qword read_qword(off_t offset)
 {
+    if (!map_check(offset, sizeof(qword)))
+        return 0;
     return *(qword *)(map + offset);
 }
 
@@ -49,15 +117,26 @@ static inline qword read_qword(off_t offset)
 #define warn(...)
 #endif
 
-/* Common globals */
+/* Common globals
+ *
+ * The options are thread-local too, so that libsemblance can dump files with
+ * different options on several threads at once. Threads started to dump files
+ * take a copy of the options with options_save() and options_restore(). */
 
 #define DUMPHEADER      0x01
 #define DUMPRSRC        0x02
 #define DUMPEXPORT      0x04
 #define DUMPIMPORT      0x08
 #define DISASSEMBLE     0x10
+#define VERIFYSUM       0x20
+#define IMAGEHASH       0x40
 #define SPECFILE        0x80
-extern word mode; /* what to dump */
+#define IMPORTHASH      0x100
+#define CLUSTER         0x200
+#define EXTRACT         0x400
+#define VERSIONINFO     0x800
+#define TRIAGE          0x1000
+extern __thread word mode; /* what to dump */
 
 #define DISASSEMBLE_ALL     0x01
 #define DEMANGLE            0x02
@@ -65,27 +144,73 @@ extern word mode; /* what to dump */
 #define NO_SHOW_ADDRESSES   0x08
 #define COMPILABLE          0x10
 #define FULL_CONTENTS       0x20
-extern word opts; /* additional options */
+extern __thread word opts; /* additional options */
 
-extern enum asm_syntax
+extern __thread enum asm_syntax
 {
     GAS,
     NASM,
     MASM,
 } asm_syntax;
 
+extern __thread enum output_format
+{
+    FORMAT_TEXT,
+    FORMAT_JSONL,
+    FORMAT_BINARY,
+} output_format;
+
 extern const char *const rsrc_types[];
 extern const size_t rsrc_types_count;
 
-extern char **resource_filters;
-extern unsigned resource_filters_count;
+extern __thread char **resource_filters;
+extern __thread unsigned resource_filters_count;
+
+/* Directory to extract resources to. */
+extern __thread const char *extract_dir;
 
 extern const char *program_name;
 
-/* Whether to print addresses relative to the image base for PE files. */
-extern int pe_rel_addr;
+/* Name of the file currently being dumped, and its position in the list. */
+extern __thread const char *file_name;
+extern __thread unsigned file_index;
+
+/* Whether to print addresses relative to the image base for PE files, or -1
+ * to decide for each file. */
+extern __thread int pe_rel_addr;
+
+struct where_clause;
+
+struct options
+{
+    word mode;
+    word opts;
+    enum asm_syntax asm_syntax;
+    enum output_format output_format;
+    char **resource_filters;
+    unsigned resource_filters_count;
+    const char *extract_dir;
+    int pe_rel_addr;
+    struct where_clause *where_clauses;
+    unsigned where_count;
+};
+
+extern void options_save(struct options *options);
+extern void options_restore(const struct options *options);
+
+/* in checksum.c */
+extern dword pe_checksum(off_t checksum_offset);
+extern dword ne_checksum(off_t crc_offset);
+
+/* in version_info.c */
+extern void print_version_record(off_t offset, dword length, int wide);
+extern void print_no_version_record(void);
+
+/* in triage.c */
+extern void triage_file(int fd);
 
 /* Entry points */
+int dump_map(void);
 void dumpmz(void);
 void dumpne(off_t offset_ne);
 void dumppe(off_t offset_pe);
@@ -0,0 +1,161 @@
+/*
+ * Dumping files on request (--server)
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "semblance.h"
+#include "demangle.h"
+#include "server.h"
+
+static int handle_request(char *line, FILE *reply)
+{
+    char **argv, *output, *p;
+    size_t output_size;
+    int argc = 1, status;
+
+    line[strcspn(line, "\r\n")] = 0;
+    for (p = line; *p; p++)
+    {
+        if (*p == '\t')
+            argc++;
+    }
+
+    argv = malloc((argc + 2) * sizeof(*argv));
+    argv[0] = (char *)program_name;
+    argc = 1;
+    if (*line)
+    {
+        for (p = strtok(line, "\t"); p; p = strtok(NULL, "\t"))
+            argv[argc++] = p;
+    }
+    argv[argc] = NULL;
+
+    if (!(out = open_memstream(&output, &output_size))) {
+        perror("Cannot allocate output buffer");
+        exit(1);
+    }
+    status = dump_request(argc, argv);
+    fclose(out);
+    /* Don't let names demangled for one request pile up over the life of the
+     * server. */
+    demangle_thread_end();
+
+    fprintf(reply, "%d %zu\n", status, output_size);
+    fwrite(output, 1, output_size, reply);
+    free(output);
+    free(argv);
+
+    return fflush(reply) == 0;
+}
+
+static void serve_stream(FILE *requests, FILE *reply)
+{
+    char *line = NULL;
+    size_t size = 0;
+
+    while (getline(&line, &size, requests) >= 0)
+    {
+        if (!handle_request(line, reply))
+            break;
+    }
+    free(line);
+}
+
+static int serve_socket(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    struct stat st;
+    int fd, conn;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long.\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    /* Take over from a server that's gone away, but not from one that's
+     * still listening. */
+    if (!stat(path, &st) && S_ISSOCK(st.st_mode)) {
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+            fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+        if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+            fprintf(stderr, "Already serving on %s.\n", path);
+            close(fd);
+            return 1;
+        }
+        if (errno != ECONNREFUSED) {
+            fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+            close(fd);
+            return 1;
+        }
+        close(fd);
+        unlink(path);
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+            || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+            || listen(fd, 16) < 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    /* A client going away shouldn't take us with it. */
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;)
+    {
+        FILE *requests, *reply;
+
+        if ((conn = accept(fd, NULL, NULL)) < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fprintf(stderr, "Cannot accept connection: %s\n", strerror(errno));
+            return 1;
+        }
+
+        requests = fdopen(conn, "r");
+        reply = fdopen(dup(conn), "w");
+        if (requests && reply)
+            serve_stream(requests, reply);
+        if (requests)
+            fclose(requests);
+        if (reply)
+            fclose(reply);
+    }
+}
+
+int serve(const char *path)
+{
+    if (path)
+        return serve_socket(path);
+    serve_stream(stdin, stdout);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef __SERVER_H
+#define __SERVER_H
+
+/* With --server, dump runs until it's killed, and dumps files as it's asked
+ * to. This saves starting up for each file, and keeps the spec database open
+ * and recent scan results in memory (see cache.h).
+ *
+ * Each request is one line, holding the arguments dump would be run with,
+ * separated by tabs. The reply is a line holding the status dump would exit
+ * with and the length of the output, separated by a space, followed by the
+ * output itself. Warnings and errors go to the server's stderr.
+ *
+ * Requests are read from stdin and replies written to stdout, or, given a
+ * path, from connections to a Unix socket there, one connection at a time. */
+
+extern int serve(const char *path);
+
+/* in dump.c: dump what a request asks for, printing it to "out". */
+extern int dump_request(int argc, char *argv[]);
+
+#endif /* __SERVER_H */
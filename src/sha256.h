@@ -0,0 +1,18 @@
+#ifndef __SHA256_H
+#define __SHA256_H
+
+#include "semblance.h"
+
+#define SHA256_DIGEST_SIZE  32
+
+struct sha256 {
+    dword state[8];
+    qword length;           /* in bytes */
+    byte buffer[64];
+};
+
+extern void sha256_init(struct sha256 *ctx);
+extern void sha256_update(struct sha256 *ctx, const void *data, size_t length);
+extern void sha256_final(struct sha256 *ctx, byte digest[SHA256_DIGEST_SIZE]);
+
+#endif /* __SHA256_H */
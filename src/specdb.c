@@ -0,0 +1,162 @@
+/*
+ * Reading specfiles and the compiled spec database
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "semblance.h"
+#include "specdb.h"
+
+/* A specfile has one export per line: the ordinal, optionally followed by a
+ * tab and the name. Blank lines and lines starting with '#' are ignored. If an
+ * ordinal is listed twice, the first one wins. */
+const char **parse_specfile(char *data, const char *filename, unsigned *count)
+{
+    const char **names = NULL;
+    unsigned size = 0;
+    char *line, *next, *p;
+    unsigned long ordinal;
+
+    *count = 0;
+
+    for (line = data; *line; line = next)
+    {
+        if ((next = strchr(line, '\n')))
+            *next++ = 0;
+        else
+            next = line + strlen(line);
+
+        if (line[0] == '#' || line[0] == 0) continue;
+
+        ordinal = strtoul(line, &p, 10);
+        if (p == line || ordinal > 0xffff) {
+            fprintf(stderr, "Error reading specfile %s near line: `%s'\n", filename, line);
+            continue;
+        }
+
+        if (ordinal >= size)
+        {
+            unsigned new_size = size ? size : 64;
+            while (new_size <= ordinal)
+                new_size *= 2;
+            names = realloc(names, new_size * sizeof(*names));
+            memset(names + size, 0, (new_size - size) * sizeof(*names));
+            size = new_size;
+        }
+        if (ordinal >= *count)
+            *count = ordinal + 1;
+
+        if (!names[ordinal] && (p = strchr(line, '\t')))
+            names[ordinal] = p + 1;
+    }
+
+    return names;
+}
+
+static const byte *db;
+static size_t db_size;
+
+static const struct specdb_header *db_header(void)
+{
+    return (const struct specdb_header *)db;
+}
+
+static const struct specdb_module *db_modules(void)
+{
+    return (const struct specdb_module *)(db + sizeof(struct specdb_header));
+}
+
+/* Map the database. It's only checked enough here that looking things up in it
+ * can't read out of bounds. */
+int specdb_open(const char *path)
+{
+    const struct specdb_header *header;
+    struct stat st;
+    void *p;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return 0;
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(*header)) {
+        close(fd);
+        return 0;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return 0;
+
+    header = p;
+    if (header->magic != SPECDB_MAGIC || header->version != SPECDB_VERSION
+            || header->module_count > (st.st_size - sizeof(*header)) / sizeof(struct specdb_module)
+            || ((const byte *)p)[st.st_size - 1]) {
+        fprintf(stderr, "Warning: %s is not a valid spec database.\n", path);
+        munmap(p, st.st_size);
+        return 0;
+    }
+
+    db = p;
+    db_size = st.st_size;
+    return 1;
+}
+
+const dword *specdb_find(const char *module, unsigned *count)
+{
+    const struct specdb_module *modules;
+    unsigned low = 0, high, mid;
+    int cmp;
+
+    if (!db) return NULL;
+
+    modules = db_modules();
+    high = db_header()->module_count;
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+        cmp = strcmp(module, specdb_string(modules[mid].name));
+        if (!cmp)
+        {
+            if (modules[mid].ordinals > db_size
+                    || modules[mid].ordinal_count > (db_size - modules[mid].ordinals) / sizeof(dword))
+                return NULL;
+            *count = modules[mid].ordinal_count;
+            return (const dword *)(db + modules[mid].ordinals);
+        }
+        else if (cmp < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return NULL;
+}
+
+const char *specdb_string(dword offset)
+{
+    if (!offset || offset >= db_size)
+        return NULL;
+    return (const char *)(db + offset);
+}
@@ -0,0 +1,41 @@
+#ifndef __SPECDB_H
+#define __SPECDB_H
+
+#include "semblance.h"
+
+/* A compiled database of specfiles, as written by mkspecdb. Everything is
+ * little-endian, and every offset is from the start of the file.
+ *
+ *  header
+ *  module table, sorted by name
+ *  for each module, an array of name offsets indexed by ordinal; 0 means the
+ *      ordinal has no name
+ *  string pool
+ */
+
+#define SPECDB_MAGIC    0x42445053  /* "SPDB" */
+#define SPECDB_VERSION  1
+
+struct specdb_header {
+    dword magic;
+    dword version;
+    dword module_count;
+};
+
+struct specdb_module {
+    dword name;
+    dword ordinal_count;    /* one more than the highest ordinal */
+    dword ordinals;
+};
+
+/* Parse a specfile in place. Returns an array of names indexed by ordinal,
+ * pointing into the buffer, which must be NUL-terminated. */
+extern const char **parse_specfile(char *data, const char *filename, unsigned *count);
+
+extern int specdb_open(const char *path);
+/* Returns the ordinal-indexed name offsets for a module, or NULL if it isn't
+ * in the database. */
+extern const dword *specdb_find(const char *module, unsigned *count);
+extern const char *specdb_string(dword offset);
+
+#endif /* __SPECDB_H */
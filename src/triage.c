@@ -0,0 +1,194 @@
+/*
+ * Classifying files by their headers alone
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "semblance.h"
+
+/* --triage prints one line per file, from nothing but the MZ header and the
+ * NE or PE header after it. Those are read with a couple of small pread()s
+ * instead of mapping the file, which matters when there are a great many
+ * files and we only want to sort them. */
+
+static const char *const pe_subsystems[] = {
+    "unknown",          /* 0 */
+    "native",           /* 1 */
+    "gui",              /* 2 */
+    "cui",              /* 3 */
+    NULL,
+    "os2-cui",          /* 5 */
+    NULL,
+    "posix-cui",        /* 7 */
+    NULL,
+    "ce",               /* 9 */
+    "efi-app",          /* 10 */
+    "efi-boot",         /* 11 */
+    "efi-runtime",      /* 12 */
+    "efi-rom",          /* 13 */
+    "xbox",             /* 14 */
+    NULL,
+    "boot",             /* 16 */
+};
+
+static const char *const ne_exetypes[] = {
+    "unknown",          /* 0 */
+    "os2",              /* 1 */
+    "windows",          /* 2 */
+    "dos4",             /* 3 */
+    "windows386",       /* 4 */
+    "boss",             /* 5 */
+};
+
+static const char *pe_machine(word machine)
+{
+    switch (machine)
+    {
+    case 0x0000: return "unknown";
+    case 0x014c: return "i386";
+    case 0x0166: return "mips";
+    case 0x01c0: return "arm";
+    case 0x01c4: return "armnt";
+    case 0x01f0: return "powerpc";
+    case 0x0200: return "ia64";
+    case 0x8664: return "amd64";
+    case 0xaa64: return "arm64";
+    default: return NULL;
+    }
+}
+
+static word get_word(const byte *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static dword get_dword(const byte *p)
+{
+    return get_word(p) | ((dword)get_word(p + 2) << 16);
+}
+
+static ssize_t read_at(int fd, byte *buffer, size_t size, off_t offset)
+{
+    ssize_t ret;
+
+    while ((ret = pread(fd, buffer, size, offset)) < 0 && errno == EINTR);
+    return ret;
+}
+
+static void triage_pe(const byte *header, ssize_t size)
+{
+    word machine = get_word(header + 0x04), subsystem;
+    const char *name;
+
+    if (size < 0x5e)
+    {
+        fprintf(out, " format=PE truncated\n");
+        return;
+    }
+
+    /* The optional header fields we want are at the same offsets in PE32 and
+     * PE32+. */
+    subsystem = get_word(header + 0x5c);
+
+    if (get_word(header + 0x18) == 0x20b)
+        fprintf(out, " format=PE32+");
+    else if (get_word(header + 0x18) == 0x10b)
+        fprintf(out, " format=PE32");
+    else
+        fprintf(out, " format=PE optional-magic=0x%04x", get_word(header + 0x18));
+
+    if ((name = pe_machine(machine)))
+        fprintf(out, " machine=%s", name);
+    else
+        fprintf(out, " machine=0x%04x", machine);
+
+    if (get_word(header + 0x18) == 0x20b)
+        fprintf(out, " bits=64");
+    else if (get_word(header + 0x18) == 0x10b)
+        fprintf(out, " bits=32");
+
+    if (subsystem < sizeof(pe_subsystems) / sizeof(*pe_subsystems) && pe_subsystems[subsystem])
+        fprintf(out, " subsystem=%s", pe_subsystems[subsystem]);
+    else
+        fprintf(out, " subsystem=%u", subsystem);
+
+    fprintf(out, " dll=%s sections=%u entry=0x%x\n",
+            (get_word(header + 0x16) & 0x2000) ? "yes" : "no",
+            get_word(header + 0x06), get_dword(header + 0x28));
+}
+
+static void triage_ne(const byte *header, ssize_t size)
+{
+    byte exetype;
+
+    if (size < 0x40)
+    {
+        fprintf(out, " format=NE truncated\n");
+        return;
+    }
+
+    exetype = header[0x36];
+    fprintf(out, " format=NE machine=x86 bits=16");
+    if (exetype < sizeof(ne_exetypes) / sizeof(*ne_exetypes))
+        fprintf(out, " subsystem=%s", ne_exetypes[exetype]);
+    else
+        fprintf(out, " subsystem=%u", exetype);
+
+    fprintf(out, " dll=%s sections=%u entry=%u:%04x\n",
+            (get_word(header + 0x0c) & 0x8000) ? "yes" : "no",
+            get_word(header + 0x1c), get_word(header + 0x16), get_word(header + 0x14));
+}
+
+void triage_file(int fd)
+{
+    byte mz[0x40], header[0x80];
+    ssize_t size;
+    dword offset;
+
+    fprintf(out, "%s:", file_name);
+
+    if ((size = read_at(fd, mz, sizeof(mz), 0)) < 0) {
+        fprintf(out, " error=%s\n", strerror(errno));
+        return;
+    }
+    if (size < 2 || get_word(mz) != 0x5a4d) {
+        fprintf(out, " format=unknown\n");
+        return;
+    }
+    if (size < (ssize_t)sizeof(mz)) {
+        fprintf(out, " format=MZ truncated\n");
+        return;
+    }
+
+    offset = get_dword(mz + 0x3c);
+    if ((size = read_at(fd, header, sizeof(header), offset)) < 0)
+        size = 0;
+
+    if (size >= 4 && get_dword(header) == 0x4550)
+        triage_pe(header, size);
+    else if (size >= 2 && get_word(header) == 0x454e)
+        triage_ne(header, size);
+    else
+        fprintf(out, " format=MZ machine=x86 bits=16 subsystem=dos dll=no sections=0 entry=%04x:%04x\n",
+                get_word(mz + 0x16), get_word(mz + 0x14));
+}
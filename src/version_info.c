@@ -0,0 +1,200 @@
+/*
+ * Printing version information as a one-line record
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+
+#include "semblance.h"
+
+/* A block of a version resource. In NE images every block is a length, a
+ * value length, a key, and then the value and any children, each aligned to 4
+ * bytes. PE images add a type field before the key, and use UTF-16. */
+struct version_block {
+    off_t key;
+    off_t value;
+    off_t children;
+    off_t end;
+    word value_length;
+};
+
+static off_t align4(off_t offset, off_t base)
+{
+    return base + ((offset - base + 3) & ~3);
+}
+
+static int read_version_block(off_t offset, off_t base, off_t limit, int wide, struct version_block *block)
+{
+    word length;
+    off_t p;
+
+    if (offset + 4 > limit || (length = read_word(offset)) < 4)
+        return 0;
+
+    block->end = min(offset + length, limit);
+    block->value_length = read_word(offset + 2);
+    block->key = offset + (wide ? 6 : 4);
+
+    /* find the end of the key */
+    p = block->key;
+    if (wide) {
+        while (p + 2 <= block->end && read_word(p)) p += 2;
+        p += 2;
+    } else {
+        while (p < block->end && read_byte(p)) p++;
+        p++;
+    }
+
+    block->value = align4(p, base);
+    /* Text values are measured in characters in PE images. */
+    if (wide && read_word(offset + 4) == 1)
+        block->children = align4(block->value + block->value_length * 2, base);
+    else
+        block->children = align4(block->value + block->value_length, base);
+    return 1;
+}
+
+static int key_equals(off_t key, off_t end, int wide, const char *str)
+{
+    for (; *str; str++)
+    {
+        if (key + (wide ? 2 : 1) > end)
+            return 0;
+        if ((wide ? read_word(key) : read_byte(key)) != (byte)*str)
+            return 0;
+        key += wide ? 2 : 1;
+    }
+    return key + (wide ? 2 : 1) <= end && !(wide ? read_word(key) : read_byte(key));
+}
+
+/* Print a string, quoted and escaped, stopping at a null or after length
+ * characters. Anything unprintable is escaped as a byte (NE) or a UTF-16
+ * code unit (PE). */
+static void print_version_string(off_t offset, off_t end, unsigned length, int wide)
+{
+    unsigned c;
+
+    putc('"', out);
+    for (; length && offset + (wide ? 2 : 1) <= end; length--)
+    {
+        c = wide ? read_word(offset) : read_byte(offset);
+        if (!c)
+            break;
+        offset += wide ? 2 : 1;
+
+        if (c == '\t')
+            fprintf(out, "\\t");
+        else if (c == '\n')
+            fprintf(out, "\\n");
+        else if (c == '\r')
+            fprintf(out, "\\r");
+        else if (c == '"')
+            fprintf(out, "\\\"");
+        else if (c == '\\')
+            fprintf(out, "\\\\");
+        else if (c >= ' ' && c <= '~')
+            putc(c, out);
+        else if (wide)
+            fprintf(out, "\\u%04x", c);
+        else
+            fprintf(out, "\\x%02x", c);
+    }
+    putc('"', out);
+}
+
+static void print_string_table(const struct version_block *table, off_t base, int wide)
+{
+    struct version_block string;
+    off_t offset;
+
+    /* The key is the language and code page, as eight hex digits. */
+    fprintf(out, " lang=");
+    for (offset = table->key; offset < table->key + 8 * (wide ? 2 : 1); offset += wide ? 2 : 1)
+    {
+        unsigned c = wide ? read_word(offset) : read_byte(offset);
+        if (offset >= table->end || !isxdigit(c))
+            break;
+        putc(tolower(c), out);
+    }
+
+    for (offset = table->children; offset < table->end; offset = align4(string.end, base))
+    {
+        if (!read_version_block(offset, base, table->end, wide, &string))
+            break;
+
+        putc(' ', out);
+        print_version_string(string.key, string.end, ~0u, wide);
+        putc('=', out);
+        /* The value is supposed to be null-terminated, but isn't always; NE
+         * value lengths include the terminator, and Windows cuts them off at
+         * one less. */
+        print_version_string(string.value, string.end,
+                wide ? string.value_length : (string.value_length ? string.value_length - 1 : 0), wide);
+    }
+}
+
+/* Print the fixed file and product versions and all of the strings from a
+ * version resource, on one line. */
+void print_version_record(off_t offset, dword length, int wide)
+{
+    struct version_block root, info, table;
+    off_t end = min(offset + length, map_size);
+    off_t child, sub;
+
+    fprintf(out, "%s:", file_name);
+
+    if (!read_version_block(offset, offset, end, wide, &root)
+            || !key_equals(root.key, root.end, wide, "VS_VERSION_INFO")) {
+        fprintf(out, " invalid version info\n");
+        return;
+    }
+
+    if (root.value_length >= 52 && root.value + 52 <= root.end
+            && read_dword(root.value) == 0xfeef04bd) {
+        fprintf(out, " file=%u.%u.%u.%u product=%u.%u.%u.%u",
+                read_word(root.value + 10), read_word(root.value + 8),
+                read_word(root.value + 14), read_word(root.value + 12),
+                read_word(root.value + 18), read_word(root.value + 16),
+                read_word(root.value + 22), read_word(root.value + 20));
+    }
+
+    for (child = root.children; child < root.end; child = align4(info.end, offset))
+    {
+        if (!read_version_block(child, offset, root.end, wide, &info))
+            break;
+        if (!key_equals(info.key, info.end, wide, "StringFileInfo"))
+            continue;
+
+        for (sub = info.children; sub < info.end; sub = align4(table.end, offset))
+        {
+            if (!read_version_block(sub, offset, info.end, wide, &table))
+                break;
+            print_string_table(&table, offset, wide);
+        }
+    }
+
+    putc('\n', out);
+}
+
+void print_no_version_record(void)
+{
+    fprintf(out, "%s: no version info\n", file_name);
+}
@@ -0,0 +1,157 @@
+/*
+ * Choosing which instructions to print (--where)
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "semblance.h"
+#include "where.h"
+
+__thread struct where_clause *where_clauses;
+__thread unsigned where_count;
+
+static int parse_address(struct where_clause *clause, const char *str)
+{
+    char *end;
+
+    clause->any_segment = 1;
+    clause->address = strtoull(str, &end, 16);
+    if (*end == ':' && end != str) {
+        if (clause->address > 0xffff)
+            return 0;
+        clause->any_segment = 0;
+        clause->segment = clause->address;
+        str = end + 1;
+        clause->address = strtoull(str, &end, 16);
+    }
+    return end != str && !*end;
+}
+
+int where_add(struct where_clause **clauses, unsigned *count, const char *str)
+{
+    struct where_clause clause = {0};
+
+    if (!strcmp(str, "calls-import"))
+        clause.type = WHERE_CALLS_IMPORT;
+    else if (!strncmp(str, "mnemonic=", 9) && str[9]) {
+        clause.type = WHERE_MNEMONIC;
+        clause.mnemonic = strdup(str + 9);
+    } else if (!strncmp(str, "references=", 11)) {
+        clause.type = WHERE_REFERENCES;
+        if (!parse_address(&clause, str + 11))
+            return 0;
+    } else
+        return 0;
+
+    *clauses = realloc(*clauses, (*count + 1) * sizeof(**clauses));
+    (*clauses)[(*count)++] = clause;
+    return 1;
+}
+
+void where_free(struct where_clause *clauses, unsigned count)
+{
+    unsigned i;
+
+    for (i = 0; i < count; i++)
+        free(clauses[i].mnemonic);
+    free(clauses);
+}
+
+void where_add_target(struct where_refs *refs, word segment, qword address)
+{
+    if (refs->count < sizeof(refs->targets) / sizeof(refs->targets[0])) {
+        refs->targets[refs->count].segment = segment;
+        refs->targets[refs->count].address = address;
+        refs->count++;
+    }
+}
+
+void where_add_operands(struct where_refs *refs, const struct instr *instr,
+        word segment, qword next_ip)
+{
+    unsigned i;
+
+    for (i = 0; i < 3; i++)
+    {
+        const struct arg *arg = &instr->args[i];
+
+        switch (arg->type)
+        {
+        case IMM16:
+        case IMM:
+        case MOFFS:
+            where_add_target(refs, 0, arg->value);
+            break;
+        case REL8:
+        case REL:
+            where_add_target(refs, segment, arg->value);
+            break;
+        case RM:
+        case MEM:
+        case MM:
+        case XM:
+            if (instr->modrm_reg == 16)
+                where_add_target(refs, 0, next_ip + (int32_t)arg->value);
+            else if (instr->modrm_reg == -1 && (!instr->sib_scale || instr->sib_index == -1))
+                where_add_target(refs, 0, arg->value);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static int match_clause(const struct where_clause *clause, const struct instr *instr,
+        const struct where_refs *refs)
+{
+    unsigned i;
+
+    switch (clause->type)
+    {
+    case WHERE_CALLS_IMPORT:
+        return refs->import && (!strcmp(instr->op.name, "call") || !strcmp(instr->op.name, "jmp"));
+    case WHERE_MNEMONIC:
+        return !strcasecmp(instr->op.name, clause->mnemonic);
+    case WHERE_REFERENCES:
+        for (i = 0; i < refs->count; i++)
+        {
+            if (refs->targets[i].address == clause->address
+                    && (clause->any_segment || refs->targets[i].segment == clause->segment))
+                return 1;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+int where_match(const struct instr *instr, const struct where_refs *refs)
+{
+    unsigned i;
+
+    for (i = 0; i < where_count; i++)
+    {
+        if (!match_clause(&where_clauses[i], instr, refs))
+            return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,69 @@
+#ifndef __WHERE_H
+#define __WHERE_H
+
+#include "semblance.h"
+#include "x86_instr.h"
+
+/* With --where, only instructions matching every predicate given are printed.
+ * Predicates are checked on the decoded instruction and what we've worked out
+ * about its operands, before it's formatted:
+ *
+ *     calls-import     a call or jump to an imported function
+ *     mnemonic=NAME    the instruction is NAME, without any size suffix
+ *     references=ADDR  an operand is ADDR, as printed in the listing: the
+ *                      target of a jump or call, an immediate, or an absolute
+ *                      or IP-relative memory address. ADDR is hexadecimal,
+ *                      or SEGMENT:OFFSET to match only in that NE segment. */
+
+enum where_type
+{
+    WHERE_CALLS_IMPORT,
+    WHERE_MNEMONIC,
+    WHERE_REFERENCES,
+};
+
+struct where_clause
+{
+    enum where_type type;
+    char *mnemonic;
+    int any_segment;
+    word segment;
+    qword address;
+};
+
+/* The predicates, which are options like the ones in semblance.h. */
+extern __thread struct where_clause *where_clauses;
+extern __thread unsigned where_count;
+
+/* Parse a predicate and add it to the list. Returns 0 if it's not valid. */
+extern int where_add(struct where_clause **clauses, unsigned *count, const char *str);
+extern void where_free(struct where_clause *clauses, unsigned count);
+
+static inline int where_enabled(void)
+{
+    return where_count != 0;
+}
+
+/* What an instruction refers to. The printers fill this in, and then ask
+ * where_match() whether to print the instruction. */
+struct where_refs
+{
+    int import;         /* an operand is an imported function */
+    unsigned count;
+    struct
+    {
+        word segment;   /* 0 for a linear address */
+        qword address;
+    } targets[4];
+};
+
+/* Add the addresses the operands refer to, as they're printed: next_ip is the
+ * address of the next instruction, for IP-relative operands, and segment is
+ * that of jump and call targets. */
+extern void where_add_operands(struct where_refs *refs, const struct instr *instr,
+        word segment, qword next_ip);
+extern void where_add_target(struct where_refs *refs, word segment, qword address);
+
+extern int where_match(const struct instr *instr, const struct where_refs *refs);
+
+#endif /* __WHERE_H */
@@ -22,6 +22,8 @@
 
 #include <string.h>
 #include "x86_instr.h"
+#include "index.h"
+#include "record.h"
 
 /* this is easier than doing bitfields */
 #define MODOF(x)    ((x) >> 6)
@@ -2441,9 +2443,29 @@ int get_instr(dword ip, const byte *p, struct instr *instr, int bits) {
     return len;
 }
 
-void print_instr(char *ip, const byte *p, int len, byte flags, struct instr *instr, const char *comment, int bits) {
-    int i;
+/* An instruction ready to be printed, in whichever format. */
+struct instr_text {
+    const char *prefixes[8];
+    unsigned prefix_count;
+    char name[24];
+    /* the arguments in the order the syntax puts them */
+    const char *args[4];
+    unsigned arg_count;
+    char vex_reg[8];
+};
+
+static void add_prefix(struct instr_text *text, const char *prefix) {
+    text->prefixes[text->prefix_count++] = prefix;
+}
 
+static void add_arg(struct instr_text *text, const char *arg) {
+    if (arg[0])
+        text->args[text->arg_count++] = arg;
+}
+
+/* Print the arguments, and work out which prefixes to show, warning about
+ * anything that doesn't make sense. */
+static void format_instr(char *ip, struct instr *instr, int bits, struct instr_text *text) {
     /* FIXME: now that we've had to add bits to this function, get rid of ip_string */
 
     /* get the arguments */
@@ -2466,110 +2488,179 @@ void print_instr(char *ip, const byte *p, int len, byte flags, struct instr *ins
     if (instr->op.name[0] == '?')
         warn_at("Unknown opcode 0x%02x (extension %d)\n", instr->op.opcode, instr->op.subcode);
 
-    /* okay, now we begin dumping */
-    if ((flags & INSTR_JUMP) && (opts & COMPILABLE)) {
-        /* output a label, which is like an address but without the segment prefix */
-        /* FIXME: check masm */
-        if (asm_syntax == NASM)
-            printf(".");
-        printf("%s:", ip);
-    }
-
-    if (!(opts & NO_SHOW_ADDRESSES))
-        printf("%s:", ip);
-    printf("\t");
-
-    if (!(opts & NO_SHOW_RAW_INSN)) {
-        for (i=0; i<len && i<7; i++)
-            printf("%02x ", p[i]);
-        for (; i<8; i++)
-            printf("   ");
-    }
-
-    /* mark instructions that are jumped to */
-    if ((flags & INSTR_JUMP) && !(opts & COMPILABLE))
-        printf((flags & INSTR_FAR) ? ">>" : " >");
-    else
-        printf("  ");
-
-    /* print prefixes, including (fake) prefixes if ours are invalid */
+    /* prefixes, including (fake) prefixes if ours are invalid */
+    text->prefix_count = 0;
     if (instr->prefix & PREFIX_SEG_MASK) {
         /* note: is it valid to use overrides with lods and outs? */
         if (!instr->usedmem || (instr->op.arg0 == ESDI || (instr->op.arg1 == ESDI && instr->op.arg0 != DSSI))) {  /* can't be overridden */
             warn_at("Segment prefix %s used with opcode 0x%02x %s\n", seg16[(instr->prefix & PREFIX_SEG_MASK)-1], instr->op.opcode, instr->op.name);
-            printf("%s ", seg16[(instr->prefix & PREFIX_SEG_MASK)-1]);
+            add_prefix(text, seg16[(instr->prefix & PREFIX_SEG_MASK)-1]);
         }
     }
     if ((instr->prefix & PREFIX_OP32) && instr->op.size != 16 && instr->op.size != 32) {
         warn_at("Operand-size override used with opcode 0x%02x %s\n", instr->op.opcode, instr->op.name);
-        printf((asm_syntax == GAS) ? "data32 " : "o32 "); /* fixme: how should MASM print it? */
+        add_prefix(text, (asm_syntax == GAS) ? "data32" : "o32"); /* fixme: how should MASM print it? */
     }
     if ((instr->prefix & PREFIX_ADDR32) && (asm_syntax == NASM) && (instr->op.flags & OP_STRING)) {
-        printf("a32 ");
+        add_prefix(text, "a32");
     } else if ((instr->prefix & PREFIX_ADDR32) && !instr->usedmem && instr->op.opcode != 0xE3) { /* jecxz */
         warn_at("Address-size prefix used with opcode 0x%02x %s\n", instr->op.opcode, instr->op.name);
-        printf((asm_syntax == GAS) ? "addr32 " : "a32 "); /* fixme: how should MASM print it? */
+        add_prefix(text, (asm_syntax == GAS) ? "addr32" : "a32"); /* fixme: how should MASM print it? */
     }
     if (instr->prefix & PREFIX_LOCK) {
         if(!(instr->op.flags & OP_LOCK))
             warn_at("lock prefix used with opcode 0x%02x %s\n", instr->op.opcode, instr->op.name);
-        printf("lock ");
+        add_prefix(text, "lock");
     }
     if (instr->prefix & PREFIX_REPNE) {
         if(!(instr->op.flags & OP_REPNE))
             warn_at("repne prefix used with opcode 0x%02x %s\n", instr->op.opcode, instr->op.name);
-        printf("repne ");
+        add_prefix(text, "repne");
     }
     if (instr->prefix & PREFIX_REPE) {
         if(!(instr->op.flags & OP_REPE))
             warn_at("repe prefix used with opcode 0x%02x %s\n", instr->op.opcode, instr->op.name);
-        printf((instr->op.flags & OP_REPNE) ? "repe ": "rep ");
+        add_prefix(text, (instr->op.flags & OP_REPNE) ? "repe": "rep");
     }
     if (instr->prefix & PREFIX_WAIT) {
-        printf("wait ");
+        add_prefix(text, "wait");
+    }
+
+    snprintf(text->name, sizeof(text->name), "%s%s", instr->vex ? "v" : "", instr->op.name);
+
+    text->vex_reg[0] = 0;
+    if (instr->vex_reg)
+        snprintf(text->vex_reg, sizeof(text->vex_reg), (asm_syntax == GAS) ? "%%ymm%d" : "ymm%d", instr->vex_reg);
+
+    text->arg_count = 0;
+    if (asm_syntax == GAS) {
+        add_arg(text, instr->args[1].string);
+        add_arg(text, text->vex_reg);
+        add_arg(text, instr->args[0].string);
+    } else {
+        add_arg(text, instr->args[0].string);
+        add_arg(text, text->vex_reg);
+        add_arg(text, instr->args[1].string);
+    }
+    add_arg(text, instr->args[2].string);
+}
+
+static void print_instr_text(const char *ip, const byte *p, int len, byte flags,
+        const struct instr *instr, const struct instr_text *text, const char *comment) {
+    unsigned i;
+
+    if ((flags & INSTR_JUMP) && (opts & COMPILABLE)) {
+        /* output a label, which is like an address but without the segment prefix */
+        /* FIXME: check masm */
+        if (asm_syntax == NASM)
+            fprintf(out, ".");
+        fprintf(out, "%s:", ip);
     }
 
-    if (instr->vex)
-        printf("v");
-    printf("%s", instr->op.name);
+    if (!(opts & NO_SHOW_ADDRESSES))
+        fprintf(out, "%s:", ip);
+    fprintf(out, "\t");
+
+    if (!(opts & NO_SHOW_RAW_INSN)) {
+        for (i=0; i<len && i<7; i++)
+            fprintf(out, "%02x ", p[i]);
+        for (; i<8; i++)
+            fprintf(out, "   ");
+    }
+
+    /* mark instructions that are jumped to */
+    if ((flags & INSTR_JUMP) && !(opts & COMPILABLE))
+        fprintf(out, (flags & INSTR_FAR) ? ">>" : " >");
+    else
+        fprintf(out, "  ");
+
+    for (i = 0; i < text->prefix_count; i++)
+        fprintf(out, "%s ", text->prefixes[i]);
+
+    fprintf(out, "%s", text->name);
 
     if (instr->args[0].string[0] || instr->args[1].string[0])
-        printf("\t");
+        fprintf(out, "\t");
 
     if (asm_syntax == GAS) {
         /* fixme: are all of these orderings correct? */
         if (instr->args[1].string[0])
-            printf("%s,", instr->args[1].string);
+            fprintf(out, "%s,", instr->args[1].string);
         if (instr->vex_reg)
-            printf("%%ymm%d, ", instr->vex_reg);
+            fprintf(out, "%s, ", text->vex_reg);
         if (instr->args[0].string[0])
-            printf("%s", instr->args[0].string);
+            fprintf(out, "%s", instr->args[0].string);
         if (instr->args[2].string[0])
-            printf(",%s", instr->args[2].string);
+            fprintf(out, ",%s", instr->args[2].string);
     } else {
         if (instr->args[0].string[0])
-            printf("%s", instr->args[0].string);
+            fprintf(out, "%s", instr->args[0].string);
         if (instr->args[1].string[0])
-            printf(", ");
+            fprintf(out, ", ");
         if (instr->vex_reg)
-            printf("ymm%d, ", instr->vex_reg);
+            fprintf(out, "%s, ", text->vex_reg);
         if (instr->args[1].string[0])
-            printf("%s", instr->args[1].string);
+            fprintf(out, "%s", instr->args[1].string);
         if (instr->args[2].string[0])
-            printf(", %s", instr->args[2].string);
+            fprintf(out, ", %s", instr->args[2].string);
     }
     if (comment) {
-        printf(asm_syntax == GAS ? "\t// " : "\t;");
-        printf(" <%s>", comment);
+        fprintf(out, asm_syntax == GAS ? "\t// " : "\t;");
+        fprintf(out, " <%s>", comment);
     }
 
     /* if we have more than 7 bytes on this line, wrap around */
     if (len > 7 && !(opts & NO_SHOW_RAW_INSN)) {
-        printf("\n\t\t");
+        fprintf(out, "\n\t\t");
         for (i=7; i<len; i++) {
-            printf("%02x", p[i]);
-            if (i < len) printf(" ");
+            fprintf(out, "%02x", p[i]);
+            if (i < len) fprintf(out, " ");
         }
     }
-    printf("\n");
+    fprintf(out, "\n");
+}
+
+static void print_instr_record(word cs, qword address, const byte *p, int len, byte flags,
+        const struct instr_text *text, const char *comment) {
+    unsigned i;
+
+    record_begin("instruction");
+    if (cs)
+        record_far_address("address", cs, address);
+    else
+        record_address("address", address);
+    record_bytes("bytes", p, len);
+    if (text->prefix_count) {
+        record_array_begin("prefixes");
+        for (i = 0; i < text->prefix_count; i++)
+            record_array_string(text->prefixes[i]);
+        record_array_end();
+    }
+    record_string("mnemonic", text->name);
+    record_array_begin("operands");
+    for (i = 0; i < text->arg_count; i++)
+        record_array_string(text->args[i]);
+    record_array_end();
+    if (comment)
+        record_string("comment", comment);
+    if (flags & (INSTR_FUNC | INSTR_JUMP | INSTR_FAR)) {
+        record_array_begin("flags");
+        if (flags & INSTR_FUNC) record_array_string("function");
+        if (flags & INSTR_JUMP) record_array_string("jump");
+        if (flags & INSTR_FAR) record_array_string("far");
+        record_array_end();
+    }
+    record_end();
+}
+
+void print_instr(char *ip, word cs, qword address, const byte *p, int len, byte flags, struct instr *instr, const char *comment, int bits) {
+    struct instr_text text;
+
+    index_address(cs, address);
+    format_instr(ip, instr, bits, &text);
+
+    if (output_format != FORMAT_TEXT)
+        print_instr_record(cs, address, p, len, flags, &text, comment);
+    else
+        print_instr_text(ip, p, len, flags, instr, &text, comment);
 }
@@ -138,7 +138,9 @@ struct instr {
 };
 
 extern int get_instr(dword ip, const byte *p, struct instr *instr, int bits);
-extern void print_instr(char *ip, const byte *p, int len, byte flags, struct instr *instr, const char *comment, int bits);
+/* ip is the address as it's printed in the listing; cs and address are the
+ * same, for records. cs is zero for a linear address. */
+extern void print_instr(char *ip, word cs, qword address, const byte *p, int len, byte flags, struct instr *instr, const char *comment, int bits);
 
 /* 66 + 67 + seg + lock/rep + 2 bytes opcode + modrm + sib + 4 bytes displacement + 4 bytes immediate */
 #define MAX_INSTR       16